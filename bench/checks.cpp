@@ -0,0 +1,144 @@
+#include "checks.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <print>
+#include <string>
+#include <string_view>
+#include "scanner.hpp"
+
+namespace {
+    struct ReferenceKeyword {
+        std::string_view text;
+        TokenType type;
+    };
+
+    // Written out independently of scanner.cpp's KEYWORDS, so a mistake there cannot hide here.
+    constexpr std::array<ReferenceKeyword, 16> REFERENCE_KEYWORDS{{
+            {"and", TokenType::tok_and},
+            {"class", TokenType::tok_class},
+            {"else", TokenType::tok_else},
+            {"false", TokenType::tok_false},
+            {"for", TokenType::tok_for},
+            {"fun", TokenType::fun},
+            {"if", TokenType::tok_if},
+            {"nil", TokenType::nil},
+            {"or", TokenType::tok_or},
+            {"print", TokenType::tok_print},
+            {"return", TokenType::tok_ret},
+            {"super", TokenType::super},
+            {"this", TokenType::tok_this},
+            {"true", TokenType::tok_true},
+            {"var", TokenType::var},
+            {"while", TokenType::tok_while},
+    }};
+
+    constexpr std::string_view IDENTIFIER_CHARS{"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789"};
+    // Identifiers cannot start with a digit, which are the last ten IDENTIFIER_CHARS.
+    constexpr std::size_t IDENTIFIER_START_CHARS = IDENTIFIER_CHARS.size() - 10;
+    constexpr std::size_t RANDOM_IDENTIFIERS = 1000000;
+
+    TokenType referenceType(std::string_view text) {
+        for (const auto& keyword: REFERENCE_KEYWORDS) {
+            if (keyword.text == text) {
+                return keyword.type;
+            }
+        }
+        return TokenType::identifier;
+    }
+
+    class KeywordChecker {
+    public:
+        explicit KeywordChecker(std::FILE* out) : m_out{out} {}
+
+        // Scans `text` as a whole source and checks it comes back as one token of the reference type.
+        void check(std::string_view text) {
+            // A mutation can leave nothing, or a leading digit, which scans as a number rather than a name.
+            if (text.empty() || (text.front() >= '0' && text.front() <= '9')) {
+                return;
+            }
+            ++m_checked;
+
+            Scanner scanner{text};
+            Token token = scanToken(scanner);
+            TokenType expected = referenceType(text);
+            if (token.type != expected || static_cast<std::size_t>(token.length) != text.size()) {
+                ++m_failures;
+                std::println(m_out, "keyword check: '{}' scanned as type {} length {}, expected type {}", text,
+                             static_cast<int>(token.type), token.length, static_cast<int>(expected));
+            }
+        }
+
+        [[nodiscard]] std::size_t checked() const noexcept { return m_checked; }
+        [[nodiscard]] std::size_t failures() const noexcept { return m_failures; }
+
+    private:
+        std::FILE* m_out;
+        std::size_t m_checked{0};
+        std::size_t m_failures{0};
+    };
+
+    // Every string one edit away from `keyword`: each character replaced, removed, or with one inserted before it or
+    // at the end.
+    void checkMutations(KeywordChecker& checker, std::string_view keyword) {
+        for (std::size_t i{0}; i <= keyword.size(); ++i) {
+            for (char c: IDENTIFIER_CHARS) {
+                std::string inserted{keyword};
+                inserted.insert(i, 1, c);
+                checker.check(inserted);
+
+                if (i < keyword.size()) {
+                    std::string replaced{keyword};
+                    replaced[i] = c;
+                    checker.check(replaced);
+                }
+            }
+
+            if (i < keyword.size()) {
+                std::string removed{keyword};
+                removed.erase(i, 1);
+                checker.check(removed);
+            }
+        }
+    }
+
+    // Random identifiers of one to ten characters. Half are drawn from the letters keywords use, so they land on
+    // occupied hash slots far more often than uniformly random text would.
+    void checkRandom(KeywordChecker& checker) {
+        constexpr std::string_view KEYWORD_LETTERS{"acdefhiklnoprstuvw"};
+        uint64_t state{0x9e3779b97f4a7c15ull};
+        auto next = [&](std::size_t bound) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return static_cast<std::size_t>(state % bound);
+        };
+
+        std::string text;
+        for (std::size_t i{0}; i < RANDOM_IDENTIFIERS; ++i) {
+            std::size_t length = 1 + next(10);
+            bool keywordLike = next(2) == 0;
+            text.clear();
+            for (std::size_t j{0}; j < length; ++j) {
+                if (keywordLike) {
+                    text += KEYWORD_LETTERS[next(KEYWORD_LETTERS.size())];
+                } else {
+                    text += IDENTIFIER_CHARS[next(j == 0 ? IDENTIFIER_START_CHARS : IDENTIFIER_CHARS.size())];
+                }
+            }
+            checker.check(text);
+        }
+    }
+} // namespace
+
+bool checkKeywords(std::FILE* out) {
+    KeywordChecker checker{out};
+    for (const auto& keyword: REFERENCE_KEYWORDS) {
+        checker.check(keyword.text);
+        checkMutations(checker, keyword.text);
+    }
+    checkRandom(checker);
+
+    std::println(out, "keyword check: {} lexemes, {} mismatches", checker.checked(), checker.failures());
+    return checker.failures() == 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdio>
+
+// Correctness checks run by `cpplox_bench --check` instead of benchmarking. Each prints its mismatches to `out` and
+// returns whether there were none.
+
+// Scans every keyword, every one-character substitution, insertion and deletion of each keyword, and a large batch of
+// random identifiers, and compares the token type with a plain reference table of the keywords. This covers the
+// perfect-hash lookup in scanner.cpp on the runtime (memcpy) path that its static_asserts cannot reach.
+[[nodiscard]] bool checkKeywords(std::FILE* out);
@@ -0,0 +1,224 @@
+#include "harness.hpp"
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <numeric>
+#include <print>
+#include <utility>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    double toMillis(std::chrono::nanoseconds duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    // Benchmark and workload names are plain ASCII, but escape what JSON requires anyway.
+    std::string jsonString(std::string_view text) {
+        std::string escaped{"\""};
+        for (char c: text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped + "\"";
+    }
+} // namespace
+
+Timer::Timer() {
+#if defined(__linux__)
+    perf_event_attr attr{};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_counter = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+}
+
+Timer::~Timer() {
+#if defined(__linux__)
+    if (m_counter >= 0) {
+        close(m_counter);
+    }
+#endif
+}
+
+void Timer::start() {
+#if defined(__linux__)
+    if (m_counter >= 0) {
+        ioctl(m_counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    m_started = std::chrono::steady_clock::now();
+}
+
+void Timer::stop() {
+    m_elapsed += std::chrono::steady_clock::now() - m_started;
+#if defined(__linux__)
+    if (m_counter >= 0) {
+        ioctl(m_counter, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t count{0};
+        if (read(m_counter, &count, sizeof(count)) == sizeof(count)) {
+            m_instructions = count;
+        }
+    }
+#endif
+}
+
+void Timer::reset() {
+    m_elapsed = std::chrono::nanoseconds{0};
+    m_instructions = 0;
+#if defined(__linux__)
+    if (m_counter >= 0) {
+        ioctl(m_counter, PERF_EVENT_IOC_RESET, 0);
+    }
+#endif
+}
+
+std::optional<uint64_t> Timer::instructions() const noexcept {
+    if (m_counter < 0) {
+        return std::nullopt;
+    }
+    return m_instructions;
+}
+
+void Harness::run(std::string_view group, std::string_view name, std::size_t bytes, std::size_t dispatches,
+                  const std::function<void(Timer& timer)>& iteration) {
+    std::string fullName = std::format("{}/{}", group, name);
+    if (!selected(fullName)) {
+        return;
+    }
+
+    Timer timer;
+    iteration(timer);
+
+    std::vector<std::chrono::nanoseconds> samples;
+    std::vector<uint64_t> instructions;
+    std::chrono::nanoseconds total{0};
+    while (samples.size() < m_options.maxIterations &&
+           (total < m_options.minTime || samples.size() < m_options.minIterations)) {
+        timer.reset();
+        iteration(timer);
+        samples.push_back(timer.elapsed());
+        total += timer.elapsed();
+        if (auto count = timer.instructions()) {
+            instructions.push_back(*count);
+        }
+    }
+
+    std::ranges::sort(samples);
+    BenchmarkResult result{};
+    result.name = std::move(fullName);
+    result.group = group;
+    result.iterations = samples.size();
+    result.min = samples.front();
+    result.median = samples[samples.size() / 2];
+    result.mean = total / static_cast<std::chrono::nanoseconds::rep>(samples.size());
+    result.bytes = bytes;
+    result.dispatches = dispatches;
+    if (!instructions.empty()) {
+        std::ranges::sort(instructions);
+        result.cpuInstructions = instructions[instructions.size() / 2];
+    }
+
+    std::println("{:<40} {:>8} {:>12.3f} ms {:>12.3f} ms", result.name, result.iterations, toMillis(result.median),
+                 toMillis(result.min));
+    m_results.push_back(std::move(result));
+}
+
+void Harness::recordMemory(std::string_view group, std::string_view name, std::size_t items, std::size_t bytes) {
+    std::string fullName = std::format("{}/{}", group, name);
+    if (!selected(fullName) || items == 0) {
+        return;
+    }
+
+    std::println("{:<40} {:>8} {:>12.1f} B/item", fullName, items,
+                 static_cast<double>(bytes) / static_cast<double>(items));
+    m_memory.push_back({std::move(fullName), std::string{group}, items, bytes});
+}
+
+void Harness::printTable() const {
+    std::println("\n{:<40} {:>12} {:>14} {:>14}", "benchmark", "MB/s", "ns/dispatch", "instr/dispatch");
+    for (const auto& result: m_results) {
+        double seconds = std::chrono::duration<double>(result.median).count();
+        std::string throughput = result.bytes == 0 || result.median.count() == 0
+                                         ? "-"
+                                         : std::format("{:.1f}", static_cast<double>(result.bytes) / 1e6 / seconds);
+        std::string perDispatch = "-";
+        std::string instructionsPerDispatch = "-";
+        if (result.dispatches != 0) {
+            perDispatch = std::format("{:.2f}", static_cast<double>(result.median.count()) /
+                                                        static_cast<double>(result.dispatches));
+            if (result.cpuInstructions) {
+                instructionsPerDispatch = std::format("{:.1f}", static_cast<double>(*result.cpuInstructions) /
+                                                                    static_cast<double>(result.dispatches));
+            }
+        }
+        std::println("{:<40} {:>12} {:>14} {:>14}", result.name, throughput, perDispatch, instructionsPerDispatch);
+    }
+
+    if (m_memory.empty()) {
+        return;
+    }
+    std::println("\n{:<40} {:>12} {:>14} {:>14}", "benchmark", "items", "bytes", "bytes/item");
+    for (const auto& result: m_memory) {
+        std::println("{:<40} {:>12} {:>14} {:>14.1f}", result.name, result.items, result.bytes,
+                     static_cast<double>(result.bytes) / static_cast<double>(result.items));
+    }
+}
+
+bool Harness::writeJson(const std::string& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        std::println(stderr, "Failed to open file for writing: {}", path);
+        return false;
+    }
+
+#ifdef NAN_BOXING
+    constexpr bool nanBoxing = true;
+#else
+    constexpr bool nanBoxing = false;
+#endif
+#ifdef COMPUTED_GOTO
+    constexpr bool computedGoto = true;
+#else
+    constexpr bool computedGoto = false;
+#endif
+
+    file << "{\n";
+    file << std::format("  \"context\": {{\"nan_boxing\": {}, \"computed_goto\": {}, \"compiler\": {}}},\n", nanBoxing,
+                        computedGoto, jsonString(__VERSION__));
+    file << "  \"benchmarks\": [";
+    for (std::size_t i{0}; i < m_results.size(); ++i) {
+        const auto& result = m_results[i];
+        file << (i == 0 ? "\n" : ",\n");
+        file << std::format("    {{\"name\": {}, \"group\": {}, \"iterations\": {}, \"min_ns\": {}, \"median_ns\": {}, "
+                            "\"mean_ns\": {}, \"bytes\": {}, \"dispatches\": {}",
+                            jsonString(result.name), jsonString(result.group), result.iterations, result.min.count(),
+                            result.median.count(), result.mean.count(), result.bytes, result.dispatches);
+        if (result.cpuInstructions) {
+            file << std::format(", \"cpu_instructions\": {}", *result.cpuInstructions);
+        }
+        file << "}";
+    }
+    file << "\n  ],\n  \"memory\": [";
+    for (std::size_t i{0}; i < m_memory.size(); ++i) {
+        const auto& result = m_memory[i];
+        file << (i == 0 ? "\n" : ",\n");
+        file << std::format("    {{\"name\": {}, \"group\": {}, \"items\": {}, \"bytes\": {}, \"bytes_per_item\": {}}}",
+                            jsonString(result.name), jsonString(result.group), result.items, result.bytes,
+                            static_cast<double>(result.bytes) / static_cast<double>(result.items));
+    }
+    file << "\n  ]\n}\n";
+
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Accumulates the time (and, where the kernel allows it, the retired CPU instructions) between start() and stop()
+// calls, so a benchmark can leave its setup out of the measurement.
+class Timer {
+public:
+    Timer();
+    Timer(const Timer& other) = delete;
+    Timer& operator=(const Timer& other) = delete;
+    ~Timer();
+
+    void start();
+    void stop();
+    void reset();
+
+    [[nodiscard]] std::chrono::nanoseconds elapsed() const noexcept { return m_elapsed; }
+    // Empty when hardware counters are unavailable (non-Linux, or perf_event_paranoid forbids them).
+    [[nodiscard]] std::optional<uint64_t> instructions() const noexcept;
+
+private:
+    std::chrono::steady_clock::time_point m_started{};
+    std::chrono::nanoseconds m_elapsed{0};
+    int m_counter{-1};
+    uint64_t m_instructions{0};
+};
+
+struct BenchmarkResult {
+    std::string name;
+    std::string group;
+    std::size_t iterations{0};
+    std::chrono::nanoseconds min{0};
+    std::chrono::nanoseconds median{0};
+    std::chrono::nanoseconds mean{0};
+    // Input bytes handled per iteration, for throughput; 0 when not meaningful.
+    std::size_t bytes{0};
+    // Bytecode instructions dispatched per iteration, for per-opcode costs; 0 outside the execute group.
+    std::size_t dispatches{0};
+    // Median retired CPU instructions per iteration.
+    std::optional<uint64_t> cpuInstructions;
+};
+
+// Heap footprint of `items` objects kept alive together, as the VM's arena accounts for it.
+struct MemoryResult {
+    std::string name;
+    std::string group;
+    std::size_t items{0};
+    std::size_t bytes{0};
+};
+
+struct HarnessOptions {
+    // Each benchmark runs until it has spent this long in measured code and completed at least `minIterations`.
+    std::chrono::nanoseconds minTime{std::chrono::milliseconds(200)};
+    std::size_t minIterations{3};
+    std::size_t maxIterations{100000};
+    // Only benchmarks whose name contains this run.
+    std::string filter;
+};
+
+// Runs benchmarks one after another on the calling thread: one unmeasured warm-up iteration, then measured ones until
+// the time budget is spent. Results are summarised by their median, which a stray slow iteration does not move.
+class Harness {
+public:
+    explicit Harness(HarnessOptions options) : m_options{std::move(options)} {}
+
+    [[nodiscard]] bool selected(std::string_view name) const { return name.find(m_options.filter) != name.npos; }
+
+    // `iteration` does one unit of work, bracketing the part to measure with timer.start() and timer.stop().
+    void run(std::string_view group, std::string_view name, std::size_t bytes, std::size_t dispatches,
+             const std::function<void(Timer& timer)>& iteration);
+
+    // Records a footprint measured by the caller; nothing is timed.
+    void recordMemory(std::string_view group, std::string_view name, std::size_t items, std::size_t bytes);
+
+    [[nodiscard]] const std::vector<BenchmarkResult>& results() const noexcept { return m_results; }
+
+    void printTable() const;
+    // Writes {"context": {...}, "benchmarks": [...], "memory": [...]} for scripts/compare_bench.py.
+    [[nodiscard]] bool writeJson(const std::string& path) const;
+
+private:
+    HarnessOptions m_options;
+    std::vector<BenchmarkResult> m_results;
+    std::vector<MemoryResult> m_memory;
+};
@@ -0,0 +1,269 @@
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "checks.hpp"
+#include "context.hpp"
+#include "harness.hpp"
+#include "inline_decl.hpp"
+#include "mapped_file.hpp"
+#include "object.hpp"
+#include "scanner.hpp"
+#include "workloads.hpp"
+
+#ifndef CPPLOX_BENCH_CORPUS_DIR
+#define CPPLOX_BENCH_CORPUS_DIR "bench/corpus"
+#endif
+
+namespace {
+    struct BenchOptions {
+        HarnessOptions harness{};
+        std::size_t scale{1};
+        std::size_t loadMegabytes{100};
+        std::filesystem::path corpus{CPPLOX_BENCH_CORPUS_DIR};
+        std::optional<std::string> jsonPath;
+        bool check{false};
+    };
+
+    std::size_t scanAll(std::string_view source) {
+        Scanner scanner{source};
+        std::size_t tokens{1};
+        while (scanToken(scanner).type != TokenType::eof) {
+            ++tokens;
+        }
+        return tokens;
+    }
+
+    // Bytecode instructions one run of `chunk` dispatches. Chunks are straight-line, so that is every instruction.
+    std::size_t countDispatches(const Chunk& chunk) {
+        std::size_t dispatches{0};
+        for (std::size_t offset{0}; offset < chunk.count();) {
+            offset += instructionSize(static_cast<OpCode>(chunk.code[offset]));
+            ++dispatches;
+        }
+        return dispatches;
+    }
+
+    void scanGroup(Harness& harness, const std::vector<Workload>& workloads) {
+        for (const auto& workload: workloads) {
+            harness.run("scan", workload.name, workload.source.size(), 0, [&](Timer& timer) {
+                timer.start();
+                [[maybe_unused]] volatile std::size_t tokens = scanAll(workload.source);
+                timer.stop();
+            });
+        }
+    }
+
+    // A fresh Context per iteration, so no iteration finds its strings already interned by the one before.
+    void compileGroup(Harness& harness, const std::vector<Workload>& workloads, int level) {
+        for (const auto& workload: workloads) {
+            harness.run("compile", std::format("O{}/{}", level, workload.name), workload.source.size(), 0,
+                        [&](Timer& timer) {
+                            auto ctx = std::make_unique<Context>();
+                            ctx->optimizer.level = level;
+                            Chunk chunk{};
+                            timer.start();
+                            [[maybe_unused]] bool ok = compile(*ctx, workload.source, &chunk);
+                            timer.stop();
+                        });
+        }
+    }
+
+    // Compiles once and times only VM::interpret. -O2 would fold most workloads to a single constant, so execution
+    // is measured at -O0 (one dispatch per source operator) and -O1 (with superinstructions). Run the suite once per
+    // CPPLOX_NAN_BOXING / CPPLOX_COMPUTED_GOTO setting to compare Value layouts and dispatch strategies; the JSON
+    // context records which build produced it.
+    void executeGroup(Harness& harness, const std::vector<Workload>& workloads, int level, std::FILE* sink) {
+        for (const auto& workload: workloads) {
+            std::string name = std::format("O{}/{}", level, workload.name);
+            if (!harness.selected("execute/" + name)) {
+                continue;
+            }
+
+            Context ctx{};
+            ctx.optimizer.level = level;
+            ctx.vm.out = sink;
+            Chunk chunk{};
+            if (!compile(ctx, workload.source, &chunk)) {
+                std::println(stderr, "Skipping execute/{}: does not compile", name);
+                continue;
+            }
+
+            harness.run("execute", name, 0, countDispatches(chunk), [&](Timer& timer) {
+                timer.start();
+                [[maybe_unused]] auto result = ctx.vm.interpret(chunk);
+                timer.stop();
+            });
+        }
+    }
+
+    // Loading and scanning a large literal file through a memory mapping against reading it into a string first,
+    // which is what runFile falls back to when mapping fails.
+    void loadGroup(Harness& harness, std::size_t megabytes) {
+        if (!harness.selected("load/")) {
+            return;
+        }
+
+        std::filesystem::path path = std::filesystem::temp_directory_path() / "cpplox_bench_load.lox";
+        std::size_t bytes{0};
+        {
+            std::string block = literalSum(100000);
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            // Repeat one block (joined by `+`) until the file is big enough; the scanner does not care that it is
+            // not one valid expression per block.
+            while (bytes < megabytes * 1000 * 1000 && file) {
+                file << block << " + ";
+                bytes += block.size() + 3;
+            }
+            file << "0\n";
+            bytes += 2;
+            if (!file) {
+                std::println(stderr, "Skipping load group: cannot write {}", path.string());
+                return;
+            }
+        }
+
+        std::string label = std::format("{}mb", megabytes);
+        harness.run("load", "mmap_" + label, bytes, 0, [&](Timer& timer) {
+            timer.start();
+            if (auto mapped = MappedFile::open(path.string())) {
+                [[maybe_unused]] volatile std::size_t tokens = scanAll(mapped->view());
+            }
+            timer.stop();
+        });
+        harness.run("load", "ifstream_" + label, bytes, 0, [&](Timer& timer) {
+            timer.start();
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            std::string buffer(static_cast<std::size_t>(file.tellg()), '\0');
+            file.seekg(0, std::ios::beg);
+            file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            [[maybe_unused]] volatile std::size_t tokens = scanAll(buffer);
+            timer.stop();
+        });
+
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+
+    // VM heap bytes per live string, object header and arena rounding included; the intern table's own storage is
+    // not counted. The strings are kept alive as constants of the chunk being compiled, a GC root. `heap_string_3`
+    // forces a heap object for a 3-byte string; a literal that short is a short string and takes no heap at all.
+    void memoryGroup(Harness& harness) {
+        constexpr std::size_t STRINGS = 10000;
+        constexpr std::array<std::size_t, 3> LENGTHS{3, 16, 64};
+        for (std::size_t length: LENGTHS) {
+            std::string name = std::format("heap_string_{}", length);
+            if (!harness.selected("memory/" + name)) {
+                continue;
+            }
+
+            auto ctx = std::make_unique<Context>();
+            Chunk live{};
+            ctx->vm.compilingChunk = &live;
+            std::size_t before = ctx->vm.arena.bytesAllocated();
+            std::string chars(length, 'a');
+            for (std::size_t i{0}; i < STRINGS; ++i) {
+                // Spell `i` in base 26 at the end so every string is distinct and none is interned twice.
+                for (std::size_t digit{0}, rest{i}; digit < length; ++digit, rest /= 26) {
+                    chars[length - 1 - digit] = static_cast<char>('a' + rest % 26);
+                }
+                live.addConstant(ctx->vm, objValue(copyString(ctx->vm, chars.data(), static_cast<int>(length))));
+            }
+            harness.recordMemory("memory", name, STRINGS, ctx->vm.arena.bytesAllocated() - before);
+            ctx->vm.compilingChunk = nullptr;
+        }
+    }
+
+    std::optional<std::size_t> parseCount(std::string_view text) {
+        std::size_t value{0};
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (ec != std::errc{} || end != text.data() + text.size() || value == 0) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    void printUsage() {
+        std::println(stderr, "Usage: cpplox_bench [--check] [--filter text] [--json out.json] [--min-time ms] "
+                             "[--scale n] [--load-mb n] [--corpus dir]");
+    }
+} // namespace
+
+auto main(int argc, const char* argv[]) -> int {
+    BenchOptions options{};
+    std::span args(argv, static_cast<std::size_t>(argc));
+    for (std::size_t i{1}; i < args.size(); ++i) {
+        std::string_view arg{args[i]};
+        bool hasValue = i + 1 < args.size();
+        std::optional<std::size_t> count;
+        if (arg == "--check") {
+            options.check = true;
+        } else if (arg == "--filter" && hasValue) {
+            options.harness.filter = args[++i];
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = args[++i];
+        } else if (arg == "--corpus" && hasValue) {
+            options.corpus = args[++i];
+        } else if (arg == "--min-time" && hasValue && (count = parseCount(args[++i]))) {
+            options.harness.minTime = std::chrono::milliseconds(*count);
+        } else if (arg == "--scale" && hasValue && (count = parseCount(args[++i]))) {
+            options.scale = *count;
+        } else if (arg == "--load-mb" && hasValue && (count = parseCount(args[++i]))) {
+            options.loadMegabytes = *count;
+        } else {
+            printUsage();
+            return 64;
+        }
+    }
+
+    // --check runs the correctness checks in place of the benchmarks.
+    if (options.check) {
+        return checkKeywords(stdout) ? 0 : 1;
+    }
+
+    std::vector<Workload> workloads = generatedWorkloads(options.scale);
+    std::vector<Workload> corpus = corpusWorkloads(options.corpus);
+    if (corpus.empty()) {
+        std::println(stderr, "No .lox files in {}; corpus benchmarks skipped", options.corpus.string());
+    }
+    for (auto& workload: corpus) {
+        workload.name = "corpus_" + workload.name;
+        workloads.push_back(std::move(workload));
+    }
+
+    // Execute benchmarks print their result every iteration; keep that off the terminal.
+    std::FILE* sink = std::fopen("/dev/null", "w");
+    if (sink == nullptr && (sink = std::tmpfile()) == nullptr) {
+        std::println(stderr, "Cannot open an output sink for the execute group");
+        return 74;
+    }
+
+    Harness harness{options.harness};
+    std::println("{:<40} {:>8} {:>15} {:>15}", "benchmark", "iters", "median", "min");
+    scanGroup(harness, workloads);
+    compileGroup(harness, workloads, 0);
+    compileGroup(harness, workloads, 2);
+    executeGroup(harness, workloads, 0, sink);
+    executeGroup(harness, workloads, 1, sink);
+    loadGroup(harness, options.loadMegabytes);
+    memoryGroup(harness);
+    harness.printTable();
+
+    std::fclose(sink);
+
+    if (options.jsonPath && !harness.writeJson(*options.jsonPath)) {
+        return 74;
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "workloads.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+namespace {
+    // A fixed xorshift generator rather than <random>, whose distributions differ between standard libraries.
+    class Rng {
+    public:
+        uint32_t next(uint32_t bound) noexcept {
+            m_state ^= m_state << 13;
+            m_state ^= m_state >> 7;
+            m_state ^= m_state << 17;
+            return static_cast<uint32_t>(m_state % bound);
+        }
+
+    private:
+        uint64_t m_state{0x9e3779b97f4a7c15ull};
+    };
+
+    // Appends `piece`, breaking the line first if it would run past 100 columns.
+    void appendWrapped(std::string& out, std::size_t& column, std::string_view piece) {
+        if (column + piece.size() > 100) {
+            out += '\n';
+            column = 0;
+        }
+        out += piece;
+        column += piece.size();
+    }
+} // namespace
+
+std::string deepArithmetic(std::size_t depth) {
+    Rng rng;
+    std::string out(depth, '(');
+    out += "0";
+    std::size_t column = out.size();
+    for (std::size_t i{0}; i < depth; ++i) {
+        auto offset = static_cast<int>(rng.next(19)) - 9;
+        appendWrapped(out, column, std::format(") * 1.0001 + {}", offset));
+    }
+    out += '\n';
+    return out;
+}
+
+std::string stringConcatChain(std::size_t pieces) {
+    Rng rng;
+    std::string out;
+    std::size_t column{0};
+    for (std::size_t i{0}; i < pieces; ++i) {
+        appendWrapped(out, column, std::format("{}\"item{}:{}\"", i == 0 ? "" : " + ", i, rng.next(1000)));
+    }
+    out += '\n';
+    return out;
+}
+
+std::string comparisonChain(std::size_t terms) {
+    constexpr std::string_view comparisons[] = {"<", ">", "<=", ">="};
+    constexpr std::string_view equalities[] = {"==", "!="};
+    Rng rng;
+    std::string out;
+    std::size_t column{0};
+    for (std::size_t i{0}; i < terms; ++i) {
+        std::string term = std::format("{}{} {} {}", rng.next(4) == 0 ? "!" : "", rng.next(100),
+                                       comparisons[rng.next(4)], rng.next(100));
+        if (term.starts_with('!')) {
+            term = std::format("!({})", term.substr(1));
+        }
+        appendWrapped(out, column, i == 0 ? term : std::format(" {} {}", equalities[rng.next(2)], term));
+    }
+    out += '\n';
+    return out;
+}
+
+std::string literalSum(std::size_t terms) {
+    Rng rng;
+    std::string out;
+    std::size_t column{0};
+    for (std::size_t i{0}; i < terms; ++i) {
+        // The index keeps every literal distinct, so none share a pool slot.
+        appendWrapped(out, column, std::format("{}{}.{}", i == 0 ? "" : " + ", i, rng.next(100)));
+    }
+    out += '\n';
+    return out;
+}
+
+std::vector<Workload> generatedWorkloads(std::size_t scale) {
+    return {
+            {"deep_arithmetic", deepArithmetic(2000 * scale)},
+            {"string_concat", stringConcatChain(2000 * scale)},
+            {"comparisons", comparisonChain(20000 * scale)},
+            {"large_literals", literalSum(500000 * scale)},
+    };
+}
+
+std::vector<Workload> corpusWorkloads(const std::filesystem::path& dir) {
+    std::vector<Workload> workloads;
+    std::error_code ec;
+    for (const auto& entry: std::filesystem::directory_iterator(dir, ec)) {
+        if (entry.path().extension() != ".lox") {
+            continue;
+        }
+
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::string source{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        workloads.push_back({entry.path().stem().string(), std::move(source)});
+    }
+
+    std::ranges::sort(workloads, {}, &Workload::name);
+    return workloads;
+}
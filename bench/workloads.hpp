@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// A Lox program is a single expression, so every workload is one large expression shaped to stress one part of the
+// pipeline. Generators are deterministic: the same size always yields byte-for-byte the same source.
+struct Workload {
+    std::string name;
+    std::string source;
+};
+
+// Nested `(... * k + c)` groups, `depth` deep; exercises grouping recursion in the parser and arithmetic in the VM.
+[[nodiscard]] std::string deepArithmetic(std::size_t depth);
+// `"s0" + "s1" + ...` with `pieces` distinct literals; past ROPE_MIN_LENGTH every `+` adds a rope node.
+[[nodiscard]] std::string stringConcatChain(std::size_t pieces);
+// `a < b == c >= d != ...` over `terms` comparisons, with `!` sprinkled in; comparison and equality opcodes only.
+[[nodiscard]] std::string comparisonChain(std::size_t terms);
+// `n0 + n1 + ...` over `terms` distinct number literals, wrapped at 100 columns like a data file. Past 256 literals
+// the pool needs `constant_long`.
+[[nodiscard]] std::string literalSum(std::size_t terms);
+
+// The generated workloads at their default sizes multiplied by `scale`.
+[[nodiscard]] std::vector<Workload> generatedWorkloads(std::size_t scale);
+// Every .lox file in `dir`, sorted by name; empty if the directory cannot be read.
+[[nodiscard]] std::vector<Workload> corpusWorkloads(const std::filesystem::path& dir);
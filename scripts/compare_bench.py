@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Compare a cpplox_bench JSON run against a stored baseline and flag regressions.
+
+Record a baseline on the machine you measure on, then compare later runs of the same build configuration to it:
+
+    cpplox_bench --json bench/baseline.json
+    cpplox_bench --json current.json
+    scripts/compare_bench.py bench/baseline.json current.json
+
+Benchmarks are matched by name and compared on their median time. A benchmark counts as a regression when it is slower
+than the baseline by more than --threshold (default 5%), and as an improvement when it is faster by more than that.
+Memory results are compared the same way on their bytes per item. The exit status is 1 if anything regressed, so the
+script can gate CI.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as file:
+        data = json.load(file)
+    benchmarks = {bench["name"]: bench for bench in data["benchmarks"]}
+    memory = {result["name"]: result for result in data.get("memory", [])}
+    return data.get("context", {}), benchmarks, memory
+
+
+def compare(baseline, current, key, threshold, unit, scale, regressions):
+    for name in sorted(baseline.keys() & current.keys()):
+        before = baseline[name][key]
+        after = current[name][key]
+        change = (after - before) / before if before else 0.0
+        mark = ""
+        if change > threshold:
+            mark = "  REGRESSION"
+            regressions.append(name)
+        elif change < -threshold:
+            mark = "  improved"
+        print(f"{name:<40} {before / scale:>10.3f}{unit} {after / scale:>10.3f}{unit} {change:>+8.1%}{mark}")
+
+    for name in sorted(baseline.keys() - current.keys()):
+        print(f"{name:<40} missing from current run")
+    for name in sorted(current.keys() - baseline.keys()):
+        print(f"{name:<40} new, no baseline")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline", help="JSON written by cpplox_bench --json")
+    parser.add_argument("current", help="JSON written by cpplox_bench --json")
+    parser.add_argument("--threshold", type=float, default=0.05, help="relative slowdown that fails (default: 0.05)")
+    args = parser.parse_args()
+
+    baseline_context, baseline, baseline_memory = load(args.baseline)
+    current_context, current, current_memory = load(args.current)
+    if baseline_context != current_context:
+        print(f"warning: build contexts differ: {baseline_context} vs {current_context}", file=sys.stderr)
+
+    regressions = []
+    print(f"{'benchmark':<40} {'baseline':>12} {'current':>12} {'change':>8}")
+    compare(baseline, current, "median_ns", args.threshold, "ms", 1e6, regressions)
+    if baseline_memory or current_memory:
+        print(f"\n{'memory':<40} {'baseline':>12} {'current':>12} {'change':>8}")
+        compare(baseline_memory, current_memory, "bytes_per_item", args.threshold, " B", 1, regressions)
+
+    if regressions:
+        print(f"\n{len(regressions)} regression(s) over {args.threshold:.0%}: {', '.join(regressions)}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Generate src/superinstructions.def from opcode sequence counts.
+
+Collect counts over a corpus, one TSV per script, then feed them all to this script:
+
+    for f in bench/corpus/*.lox; do
+        cpplox -O1 --sequence-stats "counts/$(basename "$f" .lox).tsv" "$f" > /dev/null
+    done
+    scripts/gen_superinstructions.py counts/*.tsv > src/superinstructions.def
+
+Counts are collected at -O1 so that constant folding does not hide the operator shapes that show up once operands
+stop being literals. Candidates are ranked by the dispatches they would save (count * (length - 1)). Sequences that
+cannot be fused are skipped: `ret` ends execution, and `constant_long` operands do not fit the fused encoding.
+"""
+
+import argparse
+import collections
+import pathlib
+import re
+import sys
+
+REPO = pathlib.Path(__file__).resolve().parent.parent
+CHUNK_HPP = REPO / "src" / "chunk.hpp"
+UNFUSABLE = {"ret", "constant_long"}
+
+
+def base_operand_widths():
+    text = CHUNK_HPP.read_text()
+    start = text.index("#define BASE_OPCODE_LIST(X)")
+    end = text.index("#include", start)
+    return {name: int(width) for name, width in re.findall(r"X\((\w+), (\d+)\)", text[start:end])}
+
+
+def read_counts(paths):
+    counts = collections.Counter()
+    for path in paths:
+        for line in pathlib.Path(path).read_text().splitlines():
+            if not line.strip():
+                continue
+            count, ops = line.split("\t")
+            counts[tuple(ops.split())] += int(count)
+    return counts
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("counts", nargs="+", help="TSV files written by --sequence-stats")
+    parser.add_argument("--top", type=int, default=8, help="number of superinstructions to emit (default: 8)")
+    args = parser.parse_args()
+
+    widths = base_operand_widths()
+    counts = read_counts(args.counts)
+
+    candidates = []
+    for ops, count in counts.items():
+        if any(op not in widths for op in ops):
+            sys.exit(f"unknown opcode in {' '.join(ops)}; regenerate the counts with the current build")
+        if UNFUSABLE.intersection(ops):
+            continue
+        candidates.append((count * (len(ops) - 1), count, ops))
+
+    # Highest saving first; ties go to the shorter sequence, then alphabetically so the output is stable.
+    candidates.sort(key=lambda c: (-c[0], len(c[2]), c[2]))
+    chosen = candidates[: args.top]
+    if len(set(widths) | {"_".join(ops) for _, _, ops in chosen}) != len(widths) + len(chosen):
+        sys.exit("a generated superinstruction name collides with an existing opcode")
+
+    lines = [
+        "// Generated by scripts/gen_superinstructions.py; do not edit by hand.",
+        f"// Source: {len(args.counts)} count file(s). Columns: dispatches saved, occurrences.",
+    ]
+    for saved, count, ops in chosen:
+        lines.append(f"//   {'_'.join(ops):<32} {saved:>10} {count:>10}")
+
+    entries = [f"X({'_'.join(ops)}, {sum(widths[op] for op in ops)}, {', '.join(ops)})" for _, _, ops in chosen]
+    if not entries:
+        lines.append("#define SUPERINSTRUCTION_LIST(X)")
+    else:
+        lines.append("#define SUPERINSTRUCTION_LIST(X)".ljust(119) + "\\")
+        for i, entry in enumerate(entries):
+            entry = "    " + entry
+            lines.append(entry if i == len(entries) - 1 else entry.ljust(119) + "\\")
+
+    print("\n".join(lines))
+
+
+if __name__ == "__main__":
+    main()
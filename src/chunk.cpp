@@ -1,20 +1,65 @@
 #include "chunk.hpp"
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include "gc.hpp"
+#include "inline_decl.hpp"
 
 void Chunk::writeChunk(uint8_t byte, int line) {
+    if (lines.empty() || lines.back().line != line) {
+        lines.push_back({static_cast<int>(code.size()), line});
+    }
+
     code.push_back(byte);
-    lines.push_back(line);
+}
+
+int Chunk::getLine(std::size_t offset) const {
+    // Find the first run that starts after `offset`; the one before it covers the byte.
+    auto run = std::upper_bound(lines.begin(), lines.end(), offset, [](std::size_t target, const LineRun& lineRun) {
+        return target < static_cast<std::size_t>(lineRun.offset);
+    });
+    if (run == lines.begin()) {
+        return 0;
+    }
+
+    return std::prev(run)->line;
 }
 
 void Chunk::freeChunk() {
     code.clear();
     code.shrink_to_fit();
     freeLines();
+    quickenSites.clear();
+    quickenSites.shrink_to_fit();
     constants.freeValueArray();
+    numberConstants.clear();
+    objectConstants.clear();
+    shortStringConstants.clear();
 }
 
-int Chunk::addConstant(Value value) {
+int Chunk::addConstant(VM& vm, Value value) {
+    if (isNumber(value)) {
+        auto [it, inserted] = numberConstants.try_emplace(std::bit_cast<uint64_t>(asNumber(value)),
+                                                          static_cast<int>(constants.count()));
+        if (!inserted) {
+            return it->second;
+        }
+    } else if (isShortString(value)) {
+        auto [it, inserted] = shortStringConstants.try_emplace(asShortString(value).packed,
+                                                               static_cast<int>(constants.count()));
+        if (!inserted) {
+            return it->second;
+        }
+    } else if (isObj(value)) {
+        auto [it, inserted] = objectConstants.try_emplace(asObj(value), static_cast<int>(constants.count()));
+        if (!inserted) {
+            return it->second;
+        }
+    }
+
+    writeBarrier(vm, value);
     constants.writeValue(value);
-    return constants.count() - 1;
+    return static_cast<int>(constants.count() - 1);
 }
 
 void Chunk::freeLines() {
@@ -1,31 +1,194 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include "value.hpp"
 
+// Single source of truth for the instruction set: each entry is the opcode and the number of operand bytes that follow
+// it. The enum below, the operand-width and name tables and both dispatch loops in VM::run are generated from this
+// list, so adding an opcode here is enough to keep them in sync.
+#define BASE_OPCODE_LIST(X)                                                                                            \
+    X(constant, 1)                                                                                                     \
+    X(constant_long, 3)                                                                                                \
+    X(nil, 0)                                                                                                          \
+    X(op_true, 0)                                                                                                      \
+    X(op_false, 0)                                                                                                     \
+    X(equal, 0)                                                                                                        \
+    X(greater, 0)                                                                                                      \
+    X(less, 0)                                                                                                         \
+    X(not_equal, 0)                                                                                                    \
+    X(greater_equal, 0)                                                                                                \
+    X(less_equal, 0)                                                                                                   \
+    X(add, 0)                                                                                                          \
+    X(subtract, 0)                                                                                                     \
+    X(multiply, 0)                                                                                                     \
+    X(divide, 0)                                                                                                       \
+    X(op_not, 0)                                                                                                       \
+    X(negate, 0)                                                                                                       \
+    X(ret, 0)
+
+// Superinstructions: fused opcodes that run a short sequence of base opcodes with a single dispatch. Each entry is
+// X(name, operands, parts...). The list is generated into superinstructions.def by scripts/gen_superinstructions.py
+// from --sequence-stats counts; the VM composes their handlers from the parts' bodies and the optimizer emits them.
+#include "superinstructions.def"
+
+// Quickened opcodes: type-specialised forms the VM rewrites a generic instruction into, in place, the first time it
+// runs. Each entry is X(name, operands, generic). They guard on their operand types and rewrite themselves back to the
+// generic opcode on a miss. Only the VM emits them, so they never reach the optimizer or a .loxc file.
+#define QUICKENED_OPCODE_LIST(X)                                                                                       \
+    X(add_num_num, 0, add)                                                                                             \
+    X(add_str_str, 0, add)
+
+#define OPCODE_LIST(X) BASE_OPCODE_LIST(X) SUPERINSTRUCTION_LIST(X) QUICKENED_OPCODE_LIST(X)
+
 enum class OpCode : uint8_t {
-    constant,
-    nil,
-    op_true,
-    op_false,
-    equal,
-    greater,
-    less,
-    add,
-    subtract,
-    multiply,
-    divide,
-    op_not,
-    negate,
-    ret,
+#define OPCODE_ENUM(name, operands, ...) name,
+    OPCODE_LIST(OPCODE_ENUM)
+#undef OPCODE_ENUM
+};
+
+#define OPCODE_ONE(name, operands, ...) +1
+inline constexpr std::size_t OPCODE_COUNT = 0 OPCODE_LIST(OPCODE_ONE);
+inline constexpr std::size_t BASE_OPCODE_COUNT = 0 BASE_OPCODE_LIST(OPCODE_ONE);
+inline constexpr std::size_t SUPERINSTRUCTION_COUNT = 0 SUPERINSTRUCTION_LIST(OPCODE_ONE);
+inline constexpr std::size_t QUICKENED_OPCODE_COUNT = 0 QUICKENED_OPCODE_LIST(OPCODE_ONE);
+#undef OPCODE_ONE
+
+#define OPCODE_OPERANDS(name, operands, ...) operands,
+inline constexpr std::array<uint8_t, OPCODE_COUNT> OPCODE_OPERAND_BYTES{OPCODE_LIST(OPCODE_OPERANDS)};
+#undef OPCODE_OPERANDS
+
+#define OPCODE_NAME(name, operands, ...) #name,
+inline constexpr std::array<std::string_view, OPCODE_COUNT> OPCODE_NAMES{OPCODE_LIST(OPCODE_NAME)};
+#undef OPCODE_NAME
+
+// Total encoded size of an instruction, opcode byte included.
+[[nodiscard]] constexpr std::size_t instructionSize(OpCode op) noexcept {
+    return 1 + OPCODE_OPERAND_BYTES[static_cast<std::size_t>(op)];
+}
+
+// Applies M to each of up to three superinstruction parts.
+#define FOR_EACH_PART_2(M, a, b) M(a) M(b)
+#define FOR_EACH_PART_3(M, a, b, c) M(a) M(b) M(c)
+#define FOR_EACH_PART_PICK(_1, _2, _3, NAME, ...) NAME
+#define FOR_EACH_PART(M, ...) FOR_EACH_PART_PICK(__VA_ARGS__, FOR_EACH_PART_3, FOR_EACH_PART_2, )(M, __VA_ARGS__)
+
+inline constexpr std::size_t MAX_SUPERINSTRUCTION_PARTS = 3;
+
+struct Superinstruction {
+    OpCode op;
+    std::array<OpCode, MAX_SUPERINSTRUCTION_PARTS> parts;
+    std::size_t length;
+};
+
+#define SUPERINSTRUCTION_PART(part) OpCode::part,
+#define SUPERINSTRUCTION_ENTRY(name, operands, ...)                                                                    \
+    Superinstruction{OpCode::name, {FOR_EACH_PART(SUPERINSTRUCTION_PART, __VA_ARGS__)},                                \
+                     std::array{FOR_EACH_PART(SUPERINSTRUCTION_PART, __VA_ARGS__)}.size()},
+inline constexpr std::array<Superinstruction, SUPERINSTRUCTION_COUNT> SUPERINSTRUCTIONS{
+        {SUPERINSTRUCTION_LIST(SUPERINSTRUCTION_ENTRY)}};
+#undef SUPERINSTRUCTION_ENTRY
+#undef SUPERINSTRUCTION_PART
+
+[[nodiscard]] constexpr bool isSuperinstruction(OpCode op) noexcept {
+    auto index = static_cast<std::size_t>(op);
+    return index >= BASE_OPCODE_COUNT && index < BASE_OPCODE_COUNT + SUPERINSTRUCTION_COUNT;
+}
+
+[[nodiscard]] constexpr const Superinstruction& superinstruction(OpCode op) noexcept {
+    return SUPERINSTRUCTIONS[static_cast<std::size_t>(op) - BASE_OPCODE_COUNT];
+}
+
+#define QUICKENED_GENERIC(name, operands, generic) OpCode::generic,
+inline constexpr std::array<OpCode, QUICKENED_OPCODE_COUNT> QUICKENED_GENERICS{
+        {QUICKENED_OPCODE_LIST(QUICKENED_GENERIC)}};
+#undef QUICKENED_GENERIC
+
+inline constexpr std::size_t FIRST_QUICKENED_OPCODE = BASE_OPCODE_COUNT + SUPERINSTRUCTION_COUNT;
+
+[[nodiscard]] constexpr bool isQuickened(OpCode op) noexcept {
+    return static_cast<std::size_t>(op) >= FIRST_QUICKENED_OPCODE;
+}
+
+// The opcode a quickened instruction falls back to when its guard fails.
+[[nodiscard]] constexpr OpCode genericOpcode(OpCode op) noexcept {
+    return QUICKENED_GENERICS[static_cast<std::size_t>(op) - FIRST_QUICKENED_OPCODE];
+}
+
+// Parts must be base opcodes with short operands (the fused form has no room for `constant_long`), must not end the
+// chunk early, and the operand width listed for the fused opcode must be the sum of its parts'.
+consteval bool superinstructionsAreWellFormed() {
+    for (const auto& fused: SUPERINSTRUCTIONS) {
+        std::size_t operands{0};
+        for (std::size_t i{0}; i < fused.length; ++i) {
+            OpCode part = fused.parts[i];
+            if (isSuperinstruction(part) || isQuickened(part) || part == OpCode::constant_long || part == OpCode::ret) {
+                return false;
+            }
+            operands += OPCODE_OPERAND_BYTES[static_cast<std::size_t>(part)];
+        }
+        if (fused.length < 2 || operands != OPCODE_OPERAND_BYTES[static_cast<std::size_t>(fused.op)]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A quickened opcode overwrites its generic one in place, so both must have the same operands.
+consteval bool quickenedOpcodesAreWellFormed() {
+    for (std::size_t i{0}; i < QUICKENED_OPCODE_COUNT; ++i) {
+        auto op = static_cast<OpCode>(FIRST_QUICKENED_OPCODE + i);
+        OpCode generic = genericOpcode(op);
+        if (isSuperinstruction(generic) || isQuickened(generic) || instructionSize(op) != instructionSize(generic)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(superinstructionsAreWellFormed(), "superinstructions.def is inconsistent with BASE_OPCODE_LIST.");
+static_assert(quickenedOpcodesAreWellFormed(), "QUICKENED_OPCODE_LIST names an opcode of a different size.");
+static_assert(OPCODE_COUNT <= 256, "Opcodes must fit in one byte.");
+
+// `constant` takes a one-byte pool index; `constant_long` takes a 24-bit little-endian one.
+inline constexpr std::size_t MAX_CONSTANTS = 1 << 24;
+
+// One entry per run of consecutive bytes that came from the same source line. Runs are sorted by `offset`, the index
+// of their first byte in Chunk::code.
+struct LineRun {
+    int offset;
+    int line;
 };
 
+// How often a quickened instruction's guard held and failed.
+struct QuickenSite {
+    uint64_t hits{0};
+    uint64_t misses{0};
+};
+
+// A site that has missed this often has seen more than one operand type; it stays generic from then on instead of
+// flipping between specialisations.
+inline constexpr uint64_t QUICKEN_MISS_LIMIT = 4;
+
 struct Chunk {
     ValueArray constants;
     std::vector<uint8_t> code;
-    std::vector<int> lines;
+    std::vector<LineRun> lines;
+    // Counters for quickened instructions, indexed by code offset. Left empty until the VM first quickens an
+    // instruction in this chunk.
+    std::vector<QuickenSite> quickenSites;
+    // Pool index of every number (keyed by bit pattern), interned string and short string (keyed by its packed
+    // characters) already in `constants`, so repeated literals share one slot.
+    std::unordered_map<uint64_t, int> numberConstants;
+    std::unordered_map<const Obj*, int> objectConstants;
+    std::unordered_map<uint64_t, int> shortStringConstants;
 
-    Chunk() : constants(), code(), lines() {}
+    Chunk() :
+        constants(), code(), lines(), quickenSites(), numberConstants(), objectConstants(), shortStringConstants() {}
     Chunk(const Chunk& other) = default;
     ~Chunk() { freeChunk(); }
 
@@ -33,7 +196,10 @@ struct Chunk {
     [[nodiscard]] constexpr std::size_t capacity() const noexcept { return code.capacity(); }
 
     void writeChunk(uint8_t byte, int line);
+    [[nodiscard]] int getLine(std::size_t offset) const;
     void freeChunk();
     void freeLines();
-    int addConstant(Value value);
+    // Adds `value` to the pool unless it is already there. `vm` owns the heap the value lives in; it is needed for the
+    // write barrier.
+    int addConstant(VM& vm, Value value);
 };
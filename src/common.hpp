@@ -1,4 +0,0 @@
-#pragma once
-
-#define DEBUG_PRINT_CODE
-#define DEBUG_TRACE_EXECUTION
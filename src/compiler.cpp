@@ -1,25 +1,22 @@
 #include "compiler.hpp"
+#include <array>
 #include <charconv>
 #include <cstdint>
 #include <format>
 #include <limits>
-#include <memory>
 #include <print>
 #include <string_view>
 #include "chunk.hpp"
-#include "common.hpp"
+#include "context.hpp"
+#include "debug.hpp"
+#include "gc.hpp"
 #include "inline_decl.hpp"
+#include "optimizer.hpp"
 #include "scanner.hpp"
 
-#ifdef DEBUG_PRINT_CODE
-#include "debug.hpp"
-#endif
-
-using namespace Parsers;
-using namespace Chunks;
 
-static void expression();
-static void parsePrecedence(Precedence precedence);
+static void expression(Context& ctx);
+static void parsePrecedence(Context& ctx, Precedence precedence);
 static const ParseRule* getRule(TokenType type);
 
 template<typename E>
@@ -28,201 +25,226 @@ concept ErrorHandler = requires(E e, const Token& token, std::string_view msg) {
 };
 
 template<ErrorHandler F>
-static void handleError(F&& errorFunc, const Token& token, std::string_view msg) {
-    if (parser.panicMode())
+static void handleError(Context& ctx, F&& errorFunc, const Token& token, std::string_view msg) {
+    if (ctx.parser.panicMode())
         return;
 
-    parser.setPanicMode(true);
+    ctx.parser.setPanicMode(true);
     std::forward<F>(errorFunc)(token, msg);
-    parser.setHadError(true);
+    ctx.parser.setHadError(true);
 }
 
-static void errAt(const Token& token, std::string_view msg) {
-    std::print(stderr, "[line {}] Error", token.line);
+static void errAt(std::FILE* err, const Token& token, std::string_view msg) {
+    std::print(err, "[line {}] Error", token.line);
     if (token.type == TokenType::eof) {
-        std::print(stderr, " at end");
+        std::print(err, " at end");
     } else if (token.type != TokenType::err) {
-        std::print(stderr, " at '{}'", std::string_view(token.start, token.length));
+        std::print(err, " at '{}'", std::string_view(token.start, token.length));
     }
-    std::println(stderr, ": {}", msg);
+    std::println(err, ": {}", msg);
+}
+
+static void error(Context& ctx, std::string_view msg) {
+    handleError(ctx, [&](const Token& token, std::string_view text) { errAt(ctx.vm.err, token, text); },
+                ctx.parser.getPrev(), msg);
 }
 
-static void error(std::string_view msg) { handleError(errAt, parser.getPrev(), msg); }
-static void errAtCurrent(std::string_view msg) { handleError(errAt, parser.getCurrent(), msg); }
+static void errAtCurrent(Context& ctx, std::string_view msg) {
+    handleError(ctx, [&](const Token& token, std::string_view text) { errAt(ctx.vm.err, token, text); },
+                ctx.parser.getCurrent(), msg);
+}
 
-static void advance() {
-    parser.setPrev(parser.getCurrent());
+static void advance(Context& ctx) {
+    ctx.parser.setPrev(ctx.parser.getCurrent());
     while (true) {
-        parser.setCurrent(scanToken());
-        if (parser.getCurrent().type != TokenType::err) {
+        ctx.parser.setCurrent(scanToken(ctx.scanner));
+        if (ctx.parser.getCurrent().type != TokenType::err) {
             break;
         }
 
-        errAtCurrent(parser.getCurrent().start);
+        errAtCurrent(ctx, ctx.parser.getCurrent().start);
     }
 }
 
-static void consume(TokenType type, std::string_view msg) {
-    if (parser.getCurrent().type == type) {
-        advance();
+static void consume(Context& ctx, TokenType type, std::string_view msg) {
+    if (ctx.parser.getCurrent().type == type) {
+        advance(ctx);
         return;
     }
 
-    errAtCurrent(msg);
+    errAtCurrent(ctx, msg);
 }
 
-static void emitByte(uint8_t byte) { compilingChunk->writeChunk(byte, parser.getPrev().line); }
-static void emitBytes(uint8_t byte1, uint8_t byte2) { (emitByte(byte1), emitByte(byte2)); }
-static void emitReturn() { emitByte(static_cast<uint8_t>(OpCode::ret)); }
+static void emitByte(Context& ctx, uint8_t byte) {
+    ctx.vm.compilingChunk->writeChunk(byte, ctx.parser.getPrev().line);
+}
+static void emitBytes(Context& ctx, uint8_t byte1, uint8_t byte2) { (emitByte(ctx, byte1), emitByte(ctx, byte2)); }
+static void emitReturn(Context& ctx) { emitByte(ctx, static_cast<uint8_t>(OpCode::ret)); }
 
-static void endCompiler() {
-    emitReturn();
-#ifdef DEBUG_PRINT_CODE
-    if (!parser.hadError()) {
-        disassembleChunk(*compilingChunk, "code");
+static void endCompiler(Context& ctx) {
+    emitReturn(ctx);
+    if (!ctx.parser.hadError()) {
+        optimizeChunk(ctx.vm, ctx.optimizer, *ctx.vm.compilingChunk);
+    }
+    if (ctx.dumpBytecode && !ctx.parser.hadError()) {
+        disassembleChunk(ctx.vm.out, *ctx.vm.compilingChunk, "code");
     }
-#endif
 }
 
-static uint8_t makeConstant(Value value) {
-    int constant = compilingChunk->addConstant(value);
-    if (constant > std::numeric_limits<uint8_t>::max()) {
-        error("Too many constants in one chunk.");
+static int makeConstant(Context& ctx, Value value) {
+    int constant = ctx.vm.compilingChunk->addConstant(ctx.vm, value);
+    if (static_cast<std::size_t>(constant) >= MAX_CONSTANTS) {
+        error(ctx, "Too many constants in one chunk.");
         return 0;
     }
 
-    return static_cast<uint8_t>(constant);
+    return constant;
 }
 
-static void emitConstant(Value value) { emitBytes(static_cast<uint8_t>(OpCode::constant), makeConstant(value)); }
-static void number() {
+static void emitConstant(Context& ctx, Value value) {
+    int constant = makeConstant(ctx, value);
+    if (constant <= std::numeric_limits<uint8_t>::max()) {
+        emitBytes(ctx, static_cast<uint8_t>(OpCode::constant), static_cast<uint8_t>(constant));
+        return;
+    }
+
+    emitByte(ctx, static_cast<uint8_t>(OpCode::constant_long));
+    emitByte(ctx, static_cast<uint8_t>(constant & 0xff));
+    emitByte(ctx, static_cast<uint8_t>((constant >> 8) & 0xff));
+    emitByte(ctx, static_cast<uint8_t>((constant >> 16) & 0xff));
+}
+
+static void number(Context& ctx) {
     double value;
-    auto [ptr, ec] = std::from_chars(parser.getPrev().start, parser.getPrev().start + parser.getPrev().length, value);
+    Token token = ctx.parser.getPrev();
+    auto [ptr, ec] = std::from_chars(token.start, token.start + token.length, value);
     if (ec == std::errc()) {
-        emitConstant(value);
+        emitConstant(ctx, value);
     } else {
-        error("Invalid number format.");
+        error(ctx, "Invalid number format.");
     }
 }
 
-static void string() {
-    emitConstant(objValue(copyString(parser.getPrev().start + 1, parser.getPrev().length - 2).get()));
+static void string(Context& ctx) {
+    Token token = ctx.parser.getPrev();
+    emitConstant(ctx, stringValue(ctx.vm, {token.start + 1, static_cast<std::size_t>(token.length - 2)}));
 }
 
-static void grouping() {
-    expression();
-    consume(TokenType::right_paren, "Expect ')' after expression.");
+static void grouping(Context& ctx) {
+    expression(ctx);
+    consume(ctx, TokenType::right_paren, "Expect ')' after expression.");
 }
 
-static void unary() {
-    TokenType operatorType = parser.getPrev().type;
-    parsePrecedence(Precedence::unary);
+static void unary(Context& ctx) {
+    TokenType operatorType = ctx.parser.getPrev().type;
+    parsePrecedence(ctx, Precedence::unary);
     switch (operatorType) {
         case TokenType::bang:
-            emitByte(static_cast<uint8_t>(OpCode::op_not));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::op_not));
             break;
         case TokenType::minus:
-            emitByte(static_cast<uint8_t>(OpCode::negate));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::negate));
             break;
         default:
             return;
     }
 }
 
-static void binary() {
-    TokenType operatorType = parser.getPrev().type;
+static void binary(Context& ctx) {
+    TokenType operatorType = ctx.parser.getPrev().type;
     const ParseRule* rule = getRule(operatorType);
-    parsePrecedence(static_cast<Precedence>(static_cast<int>(rule->precedence) + 1));
+    parsePrecedence(ctx, static_cast<Precedence>(static_cast<int>(rule->precedence) + 1));
 
     switch (operatorType) {
         case TokenType::bang_equal:
-            emitBytes(static_cast<uint8_t>(OpCode::equal), static_cast<uint8_t>(OpCode::op_not));
+            emitBytes(ctx, static_cast<uint8_t>(OpCode::equal), static_cast<uint8_t>(OpCode::op_not));
             break;
         case TokenType::equal_equal:
-            emitByte(static_cast<uint8_t>(OpCode::equal));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::equal));
             break;
         case TokenType::greater:
-            emitByte(static_cast<uint8_t>(OpCode::greater));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::greater));
             break;
         case TokenType::greater_equal:
-            emitBytes(static_cast<uint8_t>(OpCode::less), static_cast<uint8_t>(OpCode::op_not));
+            emitBytes(ctx, static_cast<uint8_t>(OpCode::less), static_cast<uint8_t>(OpCode::op_not));
             break;
         case TokenType::less:
-            emitByte(static_cast<uint8_t>(OpCode::less));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::less));
             break;
         case TokenType::less_equal:
-            emitBytes(static_cast<uint8_t>(OpCode::greater), static_cast<uint8_t>(OpCode::op_not));
+            emitBytes(ctx, static_cast<uint8_t>(OpCode::greater), static_cast<uint8_t>(OpCode::op_not));
             break;
         case TokenType::plus:
-            emitByte(static_cast<uint8_t>(OpCode::add));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::add));
             break;
         case TokenType::minus:
-            emitByte(static_cast<uint8_t>(OpCode::subtract));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::subtract));
             break;
         case TokenType::star:
-            emitByte(static_cast<uint8_t>(OpCode::multiply));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::multiply));
             break;
         case TokenType::slash:
-            emitByte(static_cast<uint8_t>(OpCode::divide));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::divide));
             break;
         default:
             return;
     }
 }
 
-static void expression() { parsePrecedence(Precedence::assignment); }
-static void parsePrecedence(Precedence precedence) {
-    advance();
-    const auto& rule = getRule(parser.getPrev().type);
-    if (!rule->prefix.has_value()) {
-        error("Expect expression.");
+static void expression(Context& ctx) { parsePrecedence(ctx, Precedence::assignment); }
+static void parsePrecedence(Context& ctx, Precedence precedence) {
+    advance(ctx);
+    ParseFn prefixRule = getRule(ctx.parser.getPrev().type)->prefix;
+    if (prefixRule == nullptr) {
+        error(ctx, "Expect expression.");
         return;
     }
 
-    rule->prefix.value()();
-    while (precedence <= getRule(parser.getCurrent().type)->precedence) {
-        advance();
-        const auto& prec_rule = getRule(parser.getPrev().type);
-        if (prec_rule->infix.has_value()) {
-            prec_rule->infix.value()();
-        } else {
+    prefixRule(ctx);
+    while (precedence <= getRule(ctx.parser.getCurrent().type)->precedence) {
+        advance(ctx);
+        ParseFn infixRule = getRule(ctx.parser.getPrev().type)->infix;
+        if (infixRule == nullptr) {
             break;
         }
+
+        infixRule(ctx);
     }
 }
 
-static void literal() {
-    switch (parser.getPrev().type) {
+static void literal(Context& ctx) {
+    switch (ctx.parser.getPrev().type) {
         case TokenType::tok_false:
-            emitByte(static_cast<uint8_t>(OpCode::op_false));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::op_false));
             break;
         case TokenType::nil:
-            emitByte(static_cast<uint8_t>(OpCode::nil));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::nil));
             break;
         case TokenType::tok_true:
-            emitByte(static_cast<uint8_t>(OpCode::op_true));
+            emitByte(ctx, static_cast<uint8_t>(OpCode::op_true));
             break;
         default:
             return;
     }
 }
 
-bool compile(std::string_view source, Chunk* chunk) {
-    initScanner(source);
-    compilingChunk = std::make_unique<Chunk>(*chunk);
+bool compile(Context& ctx, std::string_view source, Chunk* chunk) {
+    initScanner(ctx.scanner, source);
+    ctx.vm.compilingChunk = chunk;
 
-    parser.setHadError(false);
-    parser.setPanicMode(false);
+    ctx.parser.setHadError(false);
+    ctx.parser.setPanicMode(false);
 
-    advance();
-    expression();
-    consume(TokenType::eof, "Expect end of expression.");
-    endCompiler();
-    return !parser.hadError();
+    advance(ctx);
+    expression(ctx);
+    consume(ctx, TokenType::eof, "Expect end of expression.");
+    endCompiler(ctx);
+    ctx.vm.compilingChunk = nullptr;
+    return !ctx.parser.hadError();
 }
 
 constexpr auto TokenTypeCount = static_cast<size_t>(TokenType::eof) + 1;
-const std::array<ParseRule, TokenTypeCount> rules = {{
+static constexpr auto rules = std::to_array<ParseRule>({
     {grouping, nullptr, Precedence::none}, // TOKEN_LEFT_PAREN
     {nullptr, nullptr, Precedence::none}, // TOKEN_RIGHT_PAREN
     {nullptr, nullptr, Precedence::none}, // TOKEN_LEFT_BRACE
@@ -263,6 +285,10 @@ const std::array<ParseRule, TokenTypeCount> rules = {{
     {nullptr, nullptr, Precedence::none}, // TOKEN_WHILE
     {nullptr, nullptr, Precedence::none}, // TOKEN_ERROR
     {nullptr, nullptr, Precedence::none}, // TOKEN_EOF
-}};
+});
+
+static_assert(rules.size() == TokenTypeCount, "Parse rule table must have one entry per TokenType.");
+static_assert(rules[static_cast<size_t>(TokenType::left_paren)].prefix == grouping, "Parse rule table is out of order.");
+static_assert(rules[static_cast<size_t>(TokenType::number)].prefix == number, "Parse rule table is out of order.");
 
 static const ParseRule* getRule(TokenType type) { return &rules[static_cast<size_t>(type)]; }
@@ -1,8 +1,5 @@
 #pragma once
 
-#include <functional>
-#include <memory>
-#include <optional>
 #include <string_view>
 #include "chunk.hpp"
 #include "scanner.hpp"
@@ -21,11 +18,13 @@ enum class Precedence : uint8_t {
     primary,
 };
 
-using ParseFn = std::function<void()>;
+struct Context;
+
+using ParseFn = void (*)(Context& ctx);
 
 struct ParseRule {
-    std::optional<ParseFn> prefix{};
-    std::optional<ParseFn> infix{};
+    ParseFn prefix{nullptr};
+    ParseFn infix{nullptr};
     Precedence precedence{};
 };
 
@@ -50,12 +49,5 @@ private:
     bool m_panicModeFlag{};
 };
 
-namespace Parsers {
-    inline constinit Parser parser{};
-}
-
-namespace Chunks {
-    inline constinit std::unique_ptr<Chunk> compilingChunk{nullptr};
-}
-
-bool compile(std::string_view source, Chunk* chunk);
+// Compiles `source` into `chunk`, allocating its string constants in ctx.vm.
+bool compile(Context& ctx, std::string_view source, Chunk* chunk);
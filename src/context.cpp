@@ -0,0 +1,13 @@
+#include "context.hpp"
+
+InterpretResult interpret(Context& ctx, std::string_view source) {
+    Chunk chunk{};
+
+    if (!compile(ctx, source, &chunk)) {
+        return InterpretResult::compile_error;
+    }
+
+    return interpret(ctx, chunk);
+}
+
+InterpretResult interpret(Context& ctx, Chunk& chunk) { return ctx.vm.interpret(chunk); }
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string_view>
+#include "compiler.hpp"
+#include "optimizer.hpp"
+#include "scanner.hpp"
+#include "vm.hpp"
+
+// Everything one interpreter needs: the front end's scanner and parser, optimizer settings and the VM with its heap
+// and stack. Contexts share no mutable state, so each thread can run its own; a single Context must not be used from
+// two threads at once. Values and objects belong to the Context that created them.
+struct Context {
+    Scanner scanner{""};
+    Parser parser{};
+    OptimizerState optimizer{};
+    VM vm{};
+    // Disassemble every chunk once it is compiled and optimised (--dump-bytecode).
+    bool dumpBytecode{false};
+    // Run a script from its sibling .loxc when that is up to date instead of compiling it.
+    bool useCache{true};
+
+    Context() = default;
+    Context(const Context& other) = delete;
+    Context& operator=(const Context& other) = delete;
+};
+
+// Compiles and runs `source` as one script.
+[[nodiscard]] InterpretResult interpret(Context& ctx, std::string_view source);
+// Runs a chunk that was compiled (or loaded from a .loxc file) ahead of time in the same Context.
+[[nodiscard]] InterpretResult interpret(Context& ctx, Chunk& chunk);
@@ -4,61 +4,132 @@
 #include "chunk.hpp"
 #include "value.hpp"
 
-void disassembleChunk(const Chunk& chunk, std::string_view name) {
-    std::println("== {} ==", name);
+void disassembleChunk(std::FILE* out, const Chunk& chunk, std::string_view name) {
+    std::println(out, "== {} ==", name);
     for (std::size_t offset{0}; offset < chunk.count();) {
-        offset = disassembleInstruction(chunk, offset);
+        offset = disassembleInstruction(out, chunk, offset);
     }
 }
 
-[[nodiscard]] static int simpleInstruction(std::string_view name, int offset) {
-    std::println("{}", name);
+[[nodiscard]] static int simpleInstruction(std::FILE* out, std::string_view name, int offset) {
+    std::println(out, "{}", name);
     return offset + 1;
 }
 
-[[nodiscard]] static int constantInstruction(std::string_view name, const Chunk& chunk, int offset) {
+[[nodiscard]] static int constantInstruction(std::FILE* out, std::string_view name, const Chunk& chunk, int offset) {
     uint8_t constant = chunk.code[offset + 1];
-    std::print("{:<10} {:4} '", name, constant);
-    printValue(chunk.constants.values[constant]);
-    std::println("'");
+    std::print(out, "{:<10} {:4} '", name, constant);
+    printValue(out, chunk.constants.values[constant]);
+    std::println(out, "'");
 
     return offset + 2;
 }
 
-[[nodiscard]] int disassembleInstruction(const Chunk& chunk, int offset) {
-    std::print("{:04} ", offset);
-    if (offset > 0 && chunk.lines[offset] == chunk.lines[offset - 1]) {
-        std::print("   | ");
+[[nodiscard]] static int constantLongInstruction(std::FILE* out, std::string_view name, const Chunk& chunk,
+                                                 int offset) {
+    auto index = static_cast<std::size_t>(offset);
+    auto constant = static_cast<uint32_t>(chunk.code[index + 1] | (chunk.code[index + 2] << 8) | (chunk.code[index + 3] << 16));
+    std::print(out, "{:<10} {:4} '", name, constant);
+    printValue(out, chunk.constants.values[constant]);
+    std::println(out, "'");
+
+    return offset + 4;
+}
+
+// Prints the fused opcode followed by each part, with its constant operand where it has one.
+[[nodiscard]] static int superInstruction(std::FILE* out, const Chunk& chunk, int offset) {
+    auto op = static_cast<OpCode>(chunk.code[offset]);
+    const Superinstruction& fused = superinstruction(op);
+    std::print(out, "{:<10}", OPCODE_NAMES[static_cast<std::size_t>(op)]);
+
+    int operand = offset + 1;
+    for (std::size_t i{0}; i < fused.length; ++i) {
+        std::print(out, " {}", OPCODE_NAMES[static_cast<std::size_t>(fused.parts[i])]);
+        if (fused.parts[i] == OpCode::constant) {
+            uint8_t constant = chunk.code[operand++];
+            std::print(out, " {} '", constant);
+            printValue(out, chunk.constants.values[constant]);
+            std::print(out, "'");
+        }
+    }
+    std::println(out);
+
+    return operand;
+}
+
+[[nodiscard]] int disassembleInstruction(std::FILE* out, const Chunk& chunk, int offset) {
+    std::print(out, "{:04} ", offset);
+    int line = chunk.getLine(static_cast<std::size_t>(offset));
+    if (offset > 0 && line == chunk.getLine(static_cast<std::size_t>(offset - 1))) {
+        std::print(out, "   | ");
     } else {
-        std::print("{:4d} ", chunk.lines[offset]);
+        std::print(out, "{:4d} ", line);
     }
 
     uint8_t instruction = chunk.code[offset];
     switch (static_cast<OpCode>(instruction)) {
         case OpCode::constant:
-            return constantInstruction("constant", chunk, offset);
+            return constantInstruction(out, "constant", chunk, offset);
+        case OpCode::constant_long:
+            return constantLongInstruction(out, "constant_long", chunk, offset);
         case OpCode::nil:
-            return simpleInstruction("OP_NIL", offset);
+            return simpleInstruction(out, "OP_NIL", offset);
         case OpCode::op_true:
-            return simpleInstruction("OP_TRUE", offset);
+            return simpleInstruction(out, "OP_TRUE", offset);
         case OpCode::op_false:
-            return simpleInstruction("OP_FALSE", offset);
+            return simpleInstruction(out, "OP_FALSE", offset);
+        case OpCode::equal:
+            return simpleInstruction(out, "equal", offset);
+        case OpCode::greater:
+            return simpleInstruction(out, "greater", offset);
+        case OpCode::less:
+            return simpleInstruction(out, "less", offset);
+        case OpCode::not_equal:
+            return simpleInstruction(out, "not_equal", offset);
+        case OpCode::greater_equal:
+            return simpleInstruction(out, "greater_equal", offset);
+        case OpCode::less_equal:
+            return simpleInstruction(out, "less_equal", offset);
         case OpCode::add:
-            return simpleInstruction("add", offset);
+            return simpleInstruction(out, "add", offset);
         case OpCode::subtract:
-            return simpleInstruction("subtract", offset);
+            return simpleInstruction(out, "subtract", offset);
         case OpCode::multiply:
-            return simpleInstruction("multiply", offset);
+            return simpleInstruction(out, "multiply", offset);
         case OpCode::divide:
-            return simpleInstruction("divide", offset);
+            return simpleInstruction(out, "divide", offset);
         case OpCode::op_not:
-            return simpleInstruction("OP_NOT", offset);
+            return simpleInstruction(out, "OP_NOT", offset);
         case OpCode::negate:
-            return simpleInstruction("negate", offset);
+            return simpleInstruction(out, "negate", offset);
         case OpCode::ret:
-            return simpleInstruction("ret", offset);
+            return simpleInstruction(out, "ret", offset);
+        case OpCode::add_num_num:
+            return simpleInstruction(out, "add_num_num", offset);
+        case OpCode::add_str_str:
+            return simpleInstruction(out, "add_str_str", offset);
         default:
-            std::println("Unknown opcode {}", instruction);
+            if (instruction < OPCODE_COUNT && isSuperinstruction(static_cast<OpCode>(instruction))) {
+                return superInstruction(out, chunk, offset);
+            }
+            std::println(out, "Unknown opcode {}", instruction);
             return offset + 1;
     }
 }
+
+void printQuickenSites(std::FILE* out, const Chunk& chunk) {
+    std::println(out, "== quickening ==");
+    if (chunk.quickenSites.empty()) {
+        return;
+    }
+
+    for (std::size_t offset{0}; offset < chunk.count();) {
+        auto op = static_cast<OpCode>(chunk.code[offset]);
+        const QuickenSite& site = chunk.quickenSites[offset];
+        if (isQuickened(op) || site.misses != 0) {
+            std::println(out, "{:04} {:4d} {:<12} hits: {}  misses: {}", offset, chunk.getLine(offset),
+                         OPCODE_NAMES[static_cast<std::size_t>(op)], site.hits, site.misses);
+        }
+        offset += instructionSize(op);
+    }
+}
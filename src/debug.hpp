@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstdio>
 #include <string_view>
 #include "chunk.hpp"
 
-void disassembleChunk(const Chunk& chunk, std::string_view name);
-int disassembleInstruction(const Chunk& chunk, int offset);
+void disassembleChunk(std::FILE* out, const Chunk& chunk, std::string_view name);
+int disassembleInstruction(std::FILE* out, const Chunk& chunk, int offset);
+// Lists every instruction the VM has quickened or de-quickened, with its current form and guard counters.
+void printQuickenSites(std::FILE* out, const Chunk& chunk);
@@ -3,10 +3,12 @@
 #include <cstdint>
 
 struct Value;
+struct VM;
 class Obj;
 
 enum class ObjType : uint8_t {
     obj_string,
+    obj_rope,
 };
 
 enum class ValueType : uint8_t {
@@ -14,4 +16,5 @@ enum class ValueType : uint8_t {
     val_nil,
     val_number,
     val_obj,
+    val_short_string,
 };
@@ -0,0 +1,247 @@
+#include "gc.hpp"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <limits>
+#include <print>
+#include <span>
+#include "inline_decl.hpp"
+#include "object.hpp"
+#include "vm.hpp"
+
+static constexpr std::size_t UNLIMITED_WORK = std::numeric_limits<std::size_t>::max();
+
+void markObject(VM& vm, Obj* object) {
+    if (object == nullptr || object->isMarked()) {
+        return;
+    }
+
+    object->setMarked(true);
+    vm.grayStack.push_back(object);
+}
+
+void markValue(VM& vm, Value value) {
+    if (isObj(value)) {
+        markObject(vm, asObj(value));
+    }
+}
+
+void writeBarrier(VM& vm, Value value) {
+    if (vm.gcPhase == GcPhase::mark || vm.gcPhase == GcPhase::sweep_strings) {
+        markValue(vm, value);
+    }
+}
+
+static void markArray(VM& vm, const ValueArray& array) {
+    for (const auto& value: array.values) {
+        markValue(vm, value);
+    }
+}
+
+static void markStack(VM& vm) {
+    for (const auto& slot: std::span(vm.stack.data(), vm.top)) {
+        markValue(vm, slot);
+    }
+}
+
+static void blackenObject(VM& vm, Obj* object) {
+    switch (object->getType()) {
+        case ObjType::obj_string:
+            break;
+        case ObjType::obj_rope: {
+            auto* rope = static_cast<ObjRope*>(object);
+            markValue(vm, rope->getLeft());
+            markValue(vm, rope->getRight());
+            markObject(vm, rope->getFlat());
+            break;
+        }
+    }
+}
+
+// Blackens up to `budget` gray objects and returns the unused part of the budget.
+static std::size_t traceReferences(VM& vm, std::size_t budget) {
+    while (budget > 0 && !vm.grayStack.empty()) {
+        Obj* object = vm.grayStack.back();
+        vm.grayStack.pop_back();
+        blackenObject(vm, object);
+        budget--;
+    }
+
+    return budget;
+}
+
+static void startCycle(VM& vm) {
+    markStack(vm);
+    if (vm.chunk != nullptr) {
+        markArray(vm, vm.chunk->constants);
+    }
+    if (vm.compilingChunk != nullptr) {
+        markArray(vm, vm.compilingChunk->constants);
+    }
+
+    vm.gcPhase = GcPhase::mark;
+}
+
+// Constants written since the cycle started went through writeBarrier(), but stack slots did not, so the stack is
+// rescanned before marking is declared complete. This pause is bounded by STACK_MAX, not by the heap size.
+static void finishMark(VM& vm) {
+    markStack(vm);
+    traceReferences(vm, UNLIMITED_WORK);
+
+    vm.gcPhase = GcPhase::sweep_strings;
+    vm.sweepStringsCursor = 0;
+    vm.sweepStringsCapacity = vm.strings.capacity();
+}
+
+// The intern table holds its strings weakly: unmarked keys are dropped before any object is freed, so a lookup can
+// never hand out a string that is about to be swept.
+static std::size_t sweepStringsStep(VM& vm, std::size_t budget) {
+    budget = traceReferences(vm, budget);
+    if (vm.strings.capacity() != vm.sweepStringsCapacity) {
+        // An insert rehashed the table and moved entries behind the cursor; start over.
+        vm.sweepStringsCursor = 0;
+        vm.sweepStringsCapacity = vm.strings.capacity();
+    }
+
+    std::size_t start = vm.sweepStringsCursor;
+    bool done = vm.strings.removeWhite(vm.sweepStringsCursor, budget);
+    std::size_t used = vm.sweepStringsCursor - start;
+    budget = used >= budget ? 0 : budget - used;
+
+    if (done && vm.grayStack.empty()) {
+        // The sweep works on a detached list; objects allocated from now on go to a fresh vm.objects.
+        vm.sweepObjects = vm.objects;
+        vm.objects = nullptr;
+        vm.gcPhase = GcPhase::sweep_objects;
+    }
+
+    return budget;
+}
+
+static void finishCycle(VM& vm) {
+    vm.gcPhase = GcPhase::idle;
+    vm.gcStats.cycles++;
+    vm.gcStats.maxCyclePauseNs = std::max(vm.gcStats.maxCyclePauseNs, vm.gcStats.currentCyclePauseNs);
+    vm.gcStats.currentCyclePauseNs = 0;
+
+    vm.nextGC = vm.arena.bytesAllocated() * GC_HEAP_GROW_FACTOR;
+    if (vm.nextGC < GC_INITIAL_THRESHOLD) {
+        vm.nextGC = GC_INITIAL_THRESHOLD;
+    }
+}
+
+static std::size_t sweepObjectsStep(VM& vm, std::size_t budget) {
+    while (budget > 0 && vm.sweepObjects != nullptr) {
+        Obj* object = vm.sweepObjects;
+        vm.sweepObjects = object->getNext();
+        budget--;
+
+        if (object->isMarked()) {
+            object->setMarked(false);
+            object->setNext(vm.objects);
+            vm.objects = object;
+        } else {
+            freeObject(vm, object);
+        }
+    }
+
+    if (vm.sweepObjects == nullptr) {
+        finishCycle(vm);
+    }
+
+    return budget;
+}
+
+// Advances the current cycle by `budget` units of work, crossing phase boundaries as long as budget remains.
+static void gcStep(VM& vm, std::size_t budget) {
+    while (budget > 0 && vm.gcPhase != GcPhase::idle) {
+        switch (vm.gcPhase) {
+            case GcPhase::mark:
+                budget = traceReferences(vm, budget);
+                if (vm.grayStack.empty()) {
+                    finishMark(vm);
+                }
+                break;
+            case GcPhase::sweep_strings:
+                budget = sweepStringsStep(vm, budget);
+                break;
+            case GcPhase::sweep_objects:
+                budget = sweepObjectsStep(vm, budget);
+                break;
+            case GcPhase::idle:
+                break;
+        }
+    }
+}
+
+// Objects are trivially destructible, so freeing one is returning its size, which depends on its type, to the arena.
+void freeObject(VM& vm, Obj* object) {
+    switch (object->getType()) {
+        case ObjType::obj_string: {
+            auto* string = static_cast<ObjString*>(object);
+            vm.arena.deallocate(string, sizeof(ObjString) + string->getLength() + 1);
+            break;
+        }
+        case ObjType::obj_rope:
+            vm.arena.deallocate(object, sizeof(ObjRope));
+            break;
+    }
+}
+
+static void recordPause(VM& vm, std::chrono::steady_clock::duration elapsed) {
+    auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    auto bucket = static_cast<std::size_t>(std::bit_width(ns | 1) - 1);
+
+    GcStats& stats = vm.gcStats;
+    stats.pauses++;
+    stats.totalPauseNs += ns;
+    stats.maxPauseNs = std::max(stats.maxPauseNs, ns);
+    stats.currentCyclePauseNs += ns;
+    stats.pauseHistogram[std::min(bucket, GcStats::BUCKETS - 1)]++;
+}
+
+void collectGarbage(VM& vm) {
+    auto start = std::chrono::steady_clock::now();
+
+    gcStep(vm, UNLIMITED_WORK);
+    startCycle(vm);
+    gcStep(vm, UNLIMITED_WORK);
+
+    recordPause(vm, std::chrono::steady_clock::now() - start);
+}
+
+void maybeCollectGarbage(VM& vm, std::size_t incomingBytes) {
+    bool overThreshold = vm.gcStress || vm.arena.bytesAllocated() + incomingBytes > vm.nextGC;
+
+    if (vm.gcMode == GcMode::full) {
+        if (overThreshold) {
+            collectGarbage(vm);
+        }
+        return;
+    }
+
+    if (vm.gcPhase == GcPhase::idle && !overThreshold) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (vm.gcPhase == GcPhase::idle) {
+        startCycle(vm);
+    }
+    gcStep(vm, GC_STEP_WORK);
+    recordPause(vm, std::chrono::steady_clock::now() - start);
+}
+
+void printGcStats(const VM& vm) {
+    const GcStats& stats = vm.gcStats;
+    std::println(stderr, "== gc ({}) ==", vm.gcMode == GcMode::full ? "full" : "incremental");
+    std::println(stderr, "cycles: {}  pauses: {}  total: {} ns  max pause: {} ns  max per cycle: {} ns", stats.cycles,
+                 stats.pauses, stats.totalPauseNs, stats.maxPauseNs, stats.maxCyclePauseNs);
+
+    for (std::size_t bucket{0}; bucket < GcStats::BUCKETS; bucket++) {
+        if (stats.pauseHistogram[bucket] == 0) {
+            continue;
+        }
+        std::println(stderr, "  < {:>12} ns: {}", uint64_t{2} << bucket, stats.pauseHistogram[bucket]);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "forward_decl.hpp"
+#include "value.hpp"
+
+constexpr std::size_t GC_INITIAL_THRESHOLD = 1024 * 1024;
+constexpr std::size_t GC_HEAP_GROW_FACTOR = 2;
+// Units of work (objects traced, intern slots checked or objects swept) done per allocation in incremental mode.
+constexpr std::size_t GC_STEP_WORK = 256;
+
+enum class GcMode : uint8_t {
+    // Stop-the-world: once the threshold is crossed, a whole cycle runs inside one allocation.
+    full,
+    // Tri-color marking and sweeping spread across allocations, GC_STEP_WORK units at a time.
+    incremental,
+};
+
+enum class GcPhase : uint8_t {
+    idle,
+    mark,
+    sweep_strings,
+    sweep_objects,
+};
+
+struct GcStats {
+    // Bucket i counts pauses that took [2^i, 2^(i+1)) nanoseconds.
+    static constexpr std::size_t BUCKETS = 40;
+
+    std::size_t cycles{0};
+    std::size_t pauses{0};
+    uint64_t totalPauseNs{0};
+    uint64_t maxPauseNs{0};
+    uint64_t maxCyclePauseNs{0};
+    uint64_t currentCyclePauseNs{0};
+    std::array<std::size_t, BUCKETS> pauseHistogram{};
+};
+
+void markValue(VM& vm, Value value);
+void markObject(VM& vm, Obj* object);
+
+// Must be called whenever a value is stored somewhere the collector will not rescan when marking finishes (anything
+// other than the VM stack). While a cycle is in progress it shades the value gray, so it cannot be freed by the
+// current cycle.
+void writeBarrier(VM& vm, Value value);
+
+// Called before every allocation of `incomingBytes`. In full mode this runs a whole collection once the threshold is
+// crossed; in incremental mode it starts a cycle and then does a bounded slice of it. --gc-stress acts as if the
+// threshold were always crossed.
+void maybeCollectGarbage(VM& vm, std::size_t incomingBytes);
+// Finishes any cycle in progress and then runs a complete one.
+void collectGarbage(VM& vm);
+void freeObject(VM& vm, Obj* object);
+void printGcStats(const VM& vm);
@@ -1,37 +1,64 @@
 #pragma once
 
+#include <bit>
 #include <cassert>
-#include <cstring>
+#include <cstdint>
 #include <string_view>
 #include "object.hpp"
 #include "value.hpp"
 
-inline constexpr bool isObj(const Value& value) noexcept { return value.type == ValueType::val_obj; }
+#ifdef NAN_BOXING
 
-inline constexpr Obj* asObj(const Value& value) {
+inline constexpr bool isObj(const Value& value) noexcept {
+    return (value.bits & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT);
+}
+
+inline Obj* asObj(const Value& value) {
     assert(isObj(value) && "Value is not an object.");
-    return std::get<Obj*>(value.as);
+    return reinterpret_cast<Obj*>(static_cast<uintptr_t>(value.bits & ~(SIGN_BIT | QNAN)));
 }
 
-inline constexpr bool isObjType(const Value& value, ObjType type) noexcept {
-    return isObj(value) && (asObj(value)->getType() == type);
+inline constexpr bool isBool(const Value& value) noexcept { return (value.bits | 1) == TRUE_VAL; }
+
+inline constexpr bool isNil(const Value& value) noexcept { return value.bits == NIL_VAL; }
+
+inline constexpr bool isNumber(const Value& value) noexcept { return (value.bits & QNAN) != QNAN; }
+
+inline constexpr bool asBool(const Value& value) {
+    assert(isBool(value) && "Value is not a boolean.");
+    return value.bits == TRUE_VAL;
 }
 
-inline constexpr bool isObjString(const Value& value) noexcept { return isObjType(value, ObjType::obj_string); }
+inline constexpr double asNumber(const Value& value) {
+    assert(isNumber(value) && "Value is not a number.");
+    return std::bit_cast<double>(value.bits);
+}
 
-inline constexpr bool isBool(const Value& value) noexcept { return value.type == ValueType::val_bool; }
+inline Value objValue(Obj* obj) { return Value(obj); }
 
-inline constexpr bool isNil(const Value& value) noexcept { return value.type == ValueType::val_nil; }
+inline constexpr bool isShortString(const Value& value) noexcept {
+    return (value.bits & (SIGN_BIT | QNAN | SHORT_STRING_BIT)) == (QNAN | SHORT_STRING_BIT);
+}
 
-inline constexpr bool isNumber(const Value& value) noexcept { return value.type == ValueType::val_number; }
+inline constexpr ShortString asShortString(const Value& value) {
+    assert(isShortString(value) && "Value is not a short string.");
+    return ShortString{value.bits & SHORT_STRING_CHARS};
+}
 
-inline constexpr Value boolValue(bool value) { return Value(value); }
+#else
 
-inline constexpr Value nilValue() { return Value{}; }
+inline constexpr bool isObj(const Value& value) noexcept { return value.type == ValueType::val_obj; }
 
-inline constexpr Value numberValue(double value) { return Value(value); }
+inline constexpr Obj* asObj(const Value& value) {
+    assert(isObj(value) && "Value is not an object.");
+    return std::get<Obj*>(value.as);
+}
 
-inline constexpr Value objValue(Obj* obj) { return Value(obj); }
+inline constexpr bool isBool(const Value& value) noexcept { return value.type == ValueType::val_bool; }
+
+inline constexpr bool isNil(const Value& value) noexcept { return value.type == ValueType::val_nil; }
+
+inline constexpr bool isNumber(const Value& value) noexcept { return value.type == ValueType::val_number; }
 
 inline constexpr bool asBool(const Value& value) {
     assert(isBool(value) && "Value is not a boolean.");
@@ -43,13 +70,62 @@ inline constexpr double asNumber(const Value& value) {
     return std::get<double>(value.as);
 }
 
-inline constexpr ObjString* asObjString(const Value& value) { return static_cast<ObjString*>(asObj(value)); }
+inline constexpr Value objValue(Obj* obj) { return Value(obj); }
+
+inline constexpr bool isShortString(const Value& value) noexcept { return value.type == ValueType::val_short_string; }
+
+inline constexpr ShortString asShortString(const Value& value) {
+    assert(isShortString(value) && "Value is not a short string.");
+    return std::get<ShortString>(value.as);
+}
 
-inline constexpr const char* asCString(const Value& value) { return asObjString(value)->getCString(); }
+#endif
+
+inline constexpr Value shortStringValue(std::string_view chars) noexcept { return Value(ShortString::pack(chars)); }
+
+inline constexpr Value boolValue(bool value) { return Value(value); }
+
+inline constexpr Value nilValue() { return Value{}; }
+
+inline constexpr Value numberValue(double value) { return Value(value); }
 
-inline constexpr std::string_view asStringView(const Value& value) { return asObjString(value)->getChars(); }
+inline bool isObjType(const Value& value, ObjType type) noexcept {
+    return isObj(value) && (asObj(value)->getType() == type);
+}
+
+inline bool isObjString(const Value& value) noexcept { return isObjType(value, ObjType::obj_string); }
+
+inline ObjString* asObjString(const Value& value) { return static_cast<ObjString*>(asObj(value)); }
+
+inline bool isObjRope(const Value& value) noexcept { return isObjType(value, ObjType::obj_rope); }
+
+inline ObjRope* asObjRope(const Value& value) { return static_cast<ObjRope*>(asObj(value)); }
+
+// Short strings, strings and ropes alike; all are valid operands of a string `add`.
+inline bool isString(const Value& value) noexcept {
+    if (!isObj(value)) {
+        return isShortString(value);
+    }
+    ObjType type = asObj(value)->getType();
+    return type == ObjType::obj_string || type == ObjType::obj_rope;
+}
+
+inline const char* asCString(const Value& value) { return asObjString(value)->getCString(); }
+
+inline std::string_view asStringView(const Value& value) { return asObjString(value)->getChars(); }
+
+inline bool isFalsey(const Value& value) { return isNil(value) || (isBool(value) && !asBool(value)); }
+
+inline bool valuesEq(Value a, Value b) {
+#ifdef NAN_BOXING
+    if (isNumber(a) && isNumber(b)) {
+        return asNumber(a) == asNumber(b);
+    }
 
-inline constexpr bool valuesEq(Value a, Value b) {
+    // Strings are interned and short strings are zero padded, so identical bits mean identical values for everything
+    // except numbers. Ropes must have been flattened first.
+    return a.bits == b.bits;
+#else
     if (a.type != b.type) {
         return false;
     }
@@ -61,13 +137,12 @@ inline constexpr bool valuesEq(Value a, Value b) {
             return true;
         case ValueType::val_number:
             return std::get<double>(a.as) == std::get<double>(b.as);
-        case ValueType::val_obj: {
-            auto aString = asObjString(a);
-            auto bString = asObjString(b);
-            return (aString->getLength() == bString->getLength()) &&
-                   std::memcmp(aString->getChars().data(), bString->getChars().data(), aString->getLength()) == 0;
-        }
+        case ValueType::val_obj:
+            return asObj(a) == asObj(b);
+        case ValueType::val_short_string:
+            return asShortString(a) == asShortString(b);
         default:
             return false;
     }
+#endif
 }
@@ -0,0 +1,375 @@
+#include "loxc.hpp"
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <print>
+#include <vector>
+#include "inline_decl.hpp"
+#include "object.hpp"
+#include "vm.hpp"
+
+namespace {
+    constexpr uint64_t FNV64_OFFSET_BASIS = 14695981039346656037ull;
+    constexpr uint64_t FNV64_PRIME = 1099511628211ull;
+
+    constexpr std::size_t HEADER_SIZE = 4 + 2 + 2 + 8 + 8 + 4 * 4;
+    constexpr std::size_t CHECKSUM_OFFSET = 16;
+
+    enum class ConstantTag : uint8_t {
+        number,
+        string,
+    };
+
+    uint64_t fnv1a64(std::string_view bytes) noexcept {
+        uint64_t hash = FNV64_OFFSET_BASIS;
+        for (char c: bytes) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= FNV64_PRIME;
+        }
+        return hash;
+    }
+
+    class Writer {
+    public:
+        template<std::unsigned_integral T>
+        void put(T value) {
+            for (std::size_t i{0}; i < sizeof(T); ++i) {
+                m_bytes.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+            }
+        }
+
+        void putBytes(std::string_view bytes) { m_bytes.insert(m_bytes.end(), bytes.begin(), bytes.end()); }
+
+        template<std::unsigned_integral T>
+        void patch(std::size_t offset, T value) {
+            for (std::size_t i{0}; i < sizeof(T); ++i) {
+                m_bytes[offset + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+            }
+        }
+
+        [[nodiscard]] std::string_view view() const noexcept { return {m_bytes.data(), m_bytes.size()}; }
+
+    private:
+        std::vector<char> m_bytes;
+    };
+
+    // Bounds-checked cursor over the mapped file. Every read past the end latches `failed` and yields zero, so callers
+    // can decode a whole section and check once.
+    class Reader {
+    public:
+        explicit Reader(std::string_view bytes) : m_bytes{bytes} {}
+
+        template<std::unsigned_integral T>
+        T get() noexcept {
+            if (!has(sizeof(T))) {
+                return 0;
+            }
+
+            T value{0};
+            for (std::size_t i{0}; i < sizeof(T); ++i) {
+                value |= static_cast<T>(static_cast<T>(static_cast<uint8_t>(m_bytes[m_pos + i])) << (8 * i));
+            }
+            m_pos += sizeof(T);
+            return value;
+        }
+
+        std::string_view getBytes(std::size_t count) noexcept {
+            if (!has(count)) {
+                return {};
+            }
+
+            auto bytes = m_bytes.substr(m_pos, count);
+            m_pos += count;
+            return bytes;
+        }
+
+        [[nodiscard]] bool failed() const noexcept { return m_failed; }
+        [[nodiscard]] std::size_t remaining() const noexcept { return m_bytes.size() - m_pos; }
+
+    private:
+        bool has(std::size_t count) noexcept {
+            if (m_failed || remaining() < count) {
+                m_failed = true;
+                return false;
+            }
+            return true;
+        }
+
+        std::string_view m_bytes;
+        std::size_t m_pos{0};
+        bool m_failed{false};
+    };
+
+    struct StackEffect {
+        int pops;
+        int pushes;
+    };
+
+    static_assert(BASE_OPCODE_COUNT == 18, "stackEffect() is missing a base opcode.");
+
+    // How many values a base opcode takes off the stack and how many it leaves; a superinstruction's effect is its
+    // parts' in order.
+    constexpr StackEffect stackEffect(OpCode op) noexcept {
+        switch (op) {
+            case OpCode::constant:
+            case OpCode::constant_long:
+            case OpCode::nil:
+            case OpCode::op_true:
+            case OpCode::op_false:
+                return {0, 1};
+            case OpCode::op_not:
+            case OpCode::negate:
+                return {1, 1};
+            case OpCode::ret:
+                return {1, 0};
+            case OpCode::equal:
+            case OpCode::greater:
+            case OpCode::less:
+            case OpCode::not_equal:
+            case OpCode::greater_equal:
+            case OpCode::less_equal:
+            case OpCode::add:
+            case OpCode::subtract:
+            case OpCode::multiply:
+            case OpCode::divide:
+                return {2, 1};
+            default:
+                // Superinstructions are checked part by part and quickened opcodes are rejected before this.
+                return {0, 0};
+        }
+    }
+
+    // Applies one base instruction to the tracked stack depth. Fails if it needs more operands than the stack holds,
+    // would grow the stack past STACK_MAX, or is a `ret` that would not leave the stack empty.
+    bool applyStackEffect(OpCode op, int& depth) noexcept {
+        auto [pops, pushes] = stackEffect(op);
+        if (depth < pops || (op == OpCode::ret && depth != 1)) {
+            return false;
+        }
+        depth += pushes - pops;
+        return depth <= STACK_MAX;
+    }
+
+    // The VM trusts its bytecode, so make sure every opcode is known, every instruction is complete, every operand
+    // names a constant that exists and the stack never underflows or overflows. The checksum only catches accidental
+    // damage; this is what keeps a crafted file from writing outside VM::stack.
+    bool validateCode(const Chunk& chunk) {
+        const auto& code = chunk.code;
+        std::size_t constantCount = chunk.constants.count();
+        auto last = OpCode::ret;
+        int depth{0};
+        for (std::size_t offset{0}; offset < code.size();) {
+            if (code[offset] >= OPCODE_COUNT) {
+                return false;
+            }
+
+            auto op = static_cast<OpCode>(code[offset]);
+            if (isQuickened(op)) {
+                return false;
+            }
+            last = op;
+            std::size_t size = instructionSize(op);
+            if (offset + size > code.size()) {
+                return false;
+            }
+
+            // A superinstruction's operands are its parts' operands in order; only `constant` parts carry one.
+            if (isSuperinstruction(op)) {
+                const Superinstruction& fused = superinstruction(op);
+                std::size_t operand = offset + 1;
+                for (std::size_t i{0}; i < fused.length; ++i) {
+                    if (fused.parts[i] == OpCode::constant && code[operand++] >= constantCount) {
+                        return false;
+                    }
+                    if (!applyStackEffect(fused.parts[i], depth)) {
+                        return false;
+                    }
+                }
+            } else if (!applyStackEffect(op, depth)) {
+                return false;
+            } else if (op == OpCode::constant && code[offset + 1] >= constantCount) {
+                return false;
+            } else if (op == OpCode::constant_long) {
+                auto index = static_cast<std::size_t>(code[offset + 1] | (code[offset + 2] << 8) |
+                                                      (code[offset + 3] << 16));
+                if (index >= constantCount) {
+                    return false;
+                }
+            }
+
+            offset += size;
+        }
+
+        // Execution only stops at `ret`; without one the VM would run off the end of the code.
+        return !code.empty() && last == OpCode::ret;
+    }
+} // namespace
+
+uint64_t hashSource(std::string_view source) noexcept { return fnv1a64(source); }
+
+std::string cachePathFor(const std::string& sourcePath) {
+    if (sourcePath.ends_with(".lox")) {
+        return sourcePath + "c";
+    }
+    return sourcePath + std::string{LOXC_EXTENSION};
+}
+
+bool isLoxcFile(std::string_view bytes) noexcept { return bytes.starts_with(LOXC_MAGIC); }
+
+bool writeLoxc(const Chunk& chunk, uint64_t sourceHash, int optLevel, const std::string& path) {
+    Writer out;
+    out.putBytes(LOXC_MAGIC);
+    out.put<uint16_t>(LOXC_VERSION);
+    out.put<uint16_t>(static_cast<uint16_t>(optLevel));
+    out.put<uint64_t>(sourceHash);
+    out.put<uint64_t>(0);
+    out.put<uint32_t>(static_cast<uint32_t>(chunk.code.size()));
+    out.put<uint32_t>(static_cast<uint32_t>(chunk.constants.count()));
+    out.put<uint32_t>(static_cast<uint32_t>(chunk.lines.size()));
+    out.put<uint32_t>(0);
+
+    out.putBytes({reinterpret_cast<const char*>(chunk.code.data()), chunk.code.size()});
+    for (const auto& run: chunk.lines) {
+        out.put<uint32_t>(static_cast<uint32_t>(run.offset));
+        out.put<uint32_t>(static_cast<uint32_t>(run.line));
+    }
+
+    for (const auto& value: chunk.constants.values) {
+        if (isNumber(value)) {
+            out.put<uint8_t>(static_cast<uint8_t>(ConstantTag::number));
+            out.put<uint64_t>(std::bit_cast<uint64_t>(asNumber(value)));
+        } else if (isShortString(value) || isObjString(value)) {
+            ShortStringBuffer buffer;
+            auto chars = isShortString(value) ? asShortString(value).unpack(buffer) : asStringView(value);
+            out.put<uint8_t>(static_cast<uint8_t>(ConstantTag::string));
+            out.put<uint32_t>(static_cast<uint32_t>(chars.size()));
+            out.putBytes(chars);
+        } else {
+            std::println(stderr, "Cannot serialize constant of this type to {}", path);
+            return false;
+        }
+    }
+
+    out.patch<uint64_t>(CHECKSUM_OFFSET, fnv1a64(out.view().substr(HEADER_SIZE)));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::println(stderr, "Failed to open file for writing: {}", path);
+        return false;
+    }
+
+    auto bytes = out.view();
+    if (!file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+        std::println(stderr, "Could not write file: {}", path);
+        return false;
+    }
+
+    return true;
+}
+
+LoxcStatus readLoxc(VM& vm, std::string_view bytes, Chunk* chunk, uint64_t expectedSourceHash, int expectedOptLevel) {
+    if (!isLoxcFile(bytes)) {
+        return LoxcStatus::not_loxc;
+    }
+
+    Reader in{bytes};
+    [[maybe_unused]] auto magic = in.getBytes(LOXC_MAGIC.size());
+    auto version = in.get<uint16_t>();
+    auto optLevel = in.get<uint16_t>();
+    auto sourceHash = in.get<uint64_t>();
+    auto checksum = in.get<uint64_t>();
+    auto codeSize = in.get<uint32_t>();
+    auto constantCount = in.get<uint32_t>();
+    auto lineCount = in.get<uint32_t>();
+    [[maybe_unused]] auto reservedTail = in.get<uint32_t>();
+    if (in.failed()) {
+        return LoxcStatus::corrupt;
+    }
+
+    if (version != LOXC_VERSION) {
+        return LoxcStatus::bad_version;
+    }
+
+    if ((expectedSourceHash != 0 && sourceHash != expectedSourceHash) ||
+        (expectedOptLevel >= 0 && optLevel != expectedOptLevel)) {
+        return LoxcStatus::stale;
+    }
+
+    if (fnv1a64(bytes.substr(HEADER_SIZE)) != checksum || constantCount > MAX_CONSTANTS) {
+        return LoxcStatus::corrupt;
+    }
+
+    chunk->freeChunk();
+    auto code = in.getBytes(codeSize);
+    chunk->code.resize(code.size());
+    if (!code.empty()) {
+        std::memcpy(chunk->code.data(), code.data(), code.size());
+    }
+
+    // Each run is 8 bytes; refuse counts the file cannot possibly hold before reserving for them.
+    if (in.failed() || lineCount > in.remaining() / 8) {
+        return LoxcStatus::corrupt;
+    }
+
+    chunk->lines.reserve(lineCount);
+    for (uint32_t i{0}; i < lineCount; ++i) {
+        auto offset = static_cast<int>(in.get<uint32_t>());
+        auto line = static_cast<int>(in.get<uint32_t>());
+        chunk->lines.push_back({offset, line});
+    }
+
+    // Interning a string can trigger a collection; the chunk being filled must stay reachable meanwhile, exactly as
+    // it is while the compiler writes to it.
+    vm.compilingChunk = chunk;
+    LoxcStatus status{LoxcStatus::ok};
+    for (uint32_t i{0}; i < constantCount && status == LoxcStatus::ok; ++i) {
+        Value value{};
+        switch (static_cast<ConstantTag>(in.get<uint8_t>())) {
+            case ConstantTag::number:
+                value = numberValue(std::bit_cast<double>(in.get<uint64_t>()));
+                break;
+            case ConstantTag::string: {
+                auto chars = in.getBytes(in.get<uint32_t>());
+                if (in.failed()) {
+                    status = LoxcStatus::corrupt;
+                    continue;
+                }
+                value = stringValue(vm, chars);
+                break;
+            }
+            default:
+                status = LoxcStatus::corrupt;
+                continue;
+        }
+
+        // A well-formed pool has no duplicates, so deduplication must hand back the next index.
+        if (in.failed() || chunk->addConstant(vm, value) != static_cast<int>(i)) {
+            status = LoxcStatus::corrupt;
+        }
+    }
+    vm.compilingChunk = nullptr;
+
+    if (status == LoxcStatus::ok && (in.remaining() != 0 || !validateCode(*chunk))) {
+        status = LoxcStatus::corrupt;
+    }
+
+    return status;
+}
+
+std::string_view describeLoxcStatus(LoxcStatus status) noexcept {
+    switch (status) {
+        case LoxcStatus::ok:
+            return "ok";
+        case LoxcStatus::not_loxc:
+            return "not a .loxc file";
+        case LoxcStatus::bad_version:
+            return "unsupported .loxc version";
+        case LoxcStatus::corrupt:
+            return "corrupt .loxc file";
+        case LoxcStatus::stale:
+            return "compiled from a different source";
+    }
+    return "unknown";
+}
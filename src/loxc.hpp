@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "chunk.hpp"
+
+// Serialized chunks (.loxc). Everything is little-endian and fixed-width so a file written on one build loads on any
+// other, whichever Value layout either was compiled with:
+//
+//   header    magic "LOXC", u16 version, u16 opt level, u64 source hash, u64 payload checksum,
+//             u32 code size, u32 constant count, u32 line-run count, u32 reserved
+//   code      raw bytecode
+//   lines     i32 offset, i32 line per LineRun
+//   constants u8 tag, then an f64 for numbers or a u32 length and the bytes for strings
+//
+// The checksum covers everything after the header. Loading is a handful of memcpys plus one intern per string
+// constant; the instruction stream is walked once to reject operands that would index past the pool.
+inline constexpr std::string_view LOXC_MAGIC{"LOXC"};
+// Bumped whenever OPCODE_LIST or the header changes, since opcodes are stored by number.
+inline constexpr uint16_t LOXC_VERSION = 5;
+inline constexpr std::string_view LOXC_EXTENSION{".loxc"};
+
+enum class LoxcStatus : uint8_t {
+    ok,
+    not_loxc,
+    bad_version,
+    corrupt,
+    stale,
+};
+
+[[nodiscard]] uint64_t hashSource(std::string_view source) noexcept;
+
+// Where the cache for a source file lives: `script.lox` -> `script.loxc`, anything else gets the extension appended.
+[[nodiscard]] std::string cachePathFor(const std::string& sourcePath);
+
+[[nodiscard]] bool isLoxcFile(std::string_view bytes) noexcept;
+
+// `optLevel` is the -O level the chunk was compiled at.
+[[nodiscard]] bool writeLoxc(const Chunk& chunk, uint64_t sourceHash, int optLevel, const std::string& path);
+
+// Rebuilds `chunk` from the bytes of a .loxc file, interning its strings in `vm`. When `expectedSourceHash` is non-zero
+// the file is rejected as stale unless it was compiled from a source with that hash, and when `expectedOptLevel` is
+// not negative, unless it was compiled at that -O level. `chunk` is only meaningful when ok is returned.
+[[nodiscard]] LoxcStatus readLoxc(VM& vm, std::string_view bytes, Chunk* chunk, uint64_t expectedSourceHash = 0,
+                                  int expectedOptLevel = -1);
+
+[[nodiscard]] std::string_view describeLoxcStatus(LoxcStatus status) noexcept;
@@ -1,15 +1,36 @@
+#include <algorithm>
 #include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <print>
 #include <span>
+#include <sstream>
+#include <string>
 #include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "compiler.hpp"
+#include "context.hpp"
+#include "gc.hpp"
+#include "loxc.hpp"
+#include "mapped_file.hpp"
+#include "optimizer.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
 #include "vm.hpp"
 
-void repl() {
+void repl(Context& ctx) {
     std::array<char, 1024> buffer{};
     while (true) {
         std::print("> ");
@@ -19,41 +40,34 @@ void repl() {
         }
 
         std::string_view line{buffer.data()};
-        [[maybe_unused]] auto x = interpret(line);
+        [[maybe_unused]] auto x = interpret(ctx, line);
     }
 }
 
-std::optional<std::string> readFile(const std::string& filepath) {
+std::optional<std::string> readFile(std::FILE* err, const std::string& filepath) {
     std::ifstream file(filepath, std::ios::binary | std::ios::ate);
     if (!file) {
-        std::println(stderr, "Failed to open file: {}", filepath);
+        std::println(err, "Failed to open file: {}", filepath);
         return std::nullopt;
     }
 
     auto fileSize = file.tellg();
     if (fileSize == -1) {
-        std::println(stderr, "Could not determine file size: {}", filepath);
+        std::println(err, "Could not determine file size: {}", filepath);
         return std::nullopt;
     }
 
     file.seekg(0, std::ios::beg);
     std::string buffer(static_cast<std::size_t>(fileSize), '\0');
     if (!file.read(buffer.data(), fileSize)) {
-        std::println(stderr, "Could not read file: {}", filepath);
+        std::println(err, "Could not read file: {}", filepath);
         return std::nullopt;
     }
 
     return buffer;
 }
 
-int runFile(const std::string& filepath) {
-    auto source = readFile(filepath);
-    if (!source) {
-        std::println(stderr, "Failed to read file: {}", filepath);
-        return 74;
-    }
-
-    InterpretResult res = interpret(*source);
+static int exitCodeFor(InterpretResult res) {
     switch (res) {
         case InterpretResult::compile_error:
             return 65;
@@ -65,21 +79,397 @@ int runFile(const std::string& filepath) {
     return 0;
 }
 
-auto main(int argc, const char* argv[]) -> int {
-    initVM();
+// Loads a sibling .loxc into `chunk` if it was compiled from exactly this source at the current -O level. Stale caches
+// are ignored silently; damaged ones are worth a warning since something rewrote them behind our back.
+static bool loadCache(Context& ctx, const std::string& filepath, std::string_view source, Chunk* chunk) {
+    if (!ctx.useCache) {
+        return false;
+    }
+
+    std::string cachePath = cachePathFor(filepath);
+    auto cache = MappedFile::open(cachePath);
+    if (!cache) {
+        return false;
+    }
+
+    LoxcStatus status = readLoxc(ctx.vm, cache->view(), chunk, hashSource(source), ctx.optimizer.level);
+    if (status == LoxcStatus::corrupt || status == LoxcStatus::not_loxc) {
+        std::println(ctx.vm.err, "Ignoring {}: {}", cachePath, describeLoxcStatus(status));
+    }
+    return status == LoxcStatus::ok;
+}
+
+static int runSource(Context& ctx, const std::string& filepath, std::string_view source) {
+    if (isLoxcFile(source)) {
+        Chunk chunk{};
+        LoxcStatus status = readLoxc(ctx.vm, source, &chunk);
+        if (status != LoxcStatus::ok) {
+            std::println(ctx.vm.err, "Failed to load {}: {}", filepath, describeLoxcStatus(status));
+            return 65;
+        }
+        return exitCodeFor(interpret(ctx, chunk));
+    }
+
+    if (Chunk chunk{}; loadCache(ctx, filepath, source, &chunk)) {
+        return exitCodeFor(interpret(ctx, chunk));
+    }
+
+    return exitCodeFor(interpret(ctx, source));
+}
+
+int runFile(Context& ctx, const std::string& filepath) {
+    // Scan straight out of the page cache when possible; tokens point into the mapping, and string constants are
+    // copied into the heap before it is unmapped.
+    if (auto mapped = MappedFile::open(filepath)) {
+        return runSource(ctx, filepath, mapped->view());
+    }
 
+    auto source = readFile(ctx.vm.err, filepath);
+    if (!source) {
+        std::println(ctx.vm.err, "Failed to read file: {}", filepath);
+        return 74;
+    }
+
+    return runSource(ctx, filepath, *source);
+}
+
+int compileFile(Context& ctx, const std::string& filepath, const std::string& outputPath) {
+    auto mapped = MappedFile::open(filepath);
+    std::optional<std::string> fallback;
+    std::string_view source;
+    if (mapped) {
+        source = mapped->view();
+    } else if ((fallback = readFile(ctx.vm.err, filepath))) {
+        source = *fallback;
+    } else {
+        std::println(ctx.vm.err, "Failed to read file: {}", filepath);
+        return 74;
+    }
+
+    Chunk chunk{};
+    if (!compile(ctx, source, &chunk)) {
+        return 65;
+    }
+
+    return writeLoxc(chunk, hashSource(source), ctx.optimizer.level, outputPath) ? 0 : 74;
+}
+
+// Appends the scripts named by one batch argument: a directory contributes every .lox file below it in path order,
+// `@list` contributes the paths listed in that file (one per line, relative to the list; blank lines and `#` comments
+// are skipped), and anything else is taken as a script.
+static bool collectScripts(const std::string& arg, std::vector<std::string>& scripts) {
+    namespace fs = std::filesystem;
+    if (arg.starts_with('@')) {
+        std::string manifestPath = arg.substr(1);
+        auto manifest = readFile(stderr, manifestPath);
+        if (!manifest) {
+            return false;
+        }
+
+        fs::path base = fs::path(manifestPath).parent_path();
+        std::istringstream lines{*manifest};
+        for (std::string line; std::getline(lines, line);) {
+            auto first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#') {
+                continue;
+            }
+
+            fs::path entry{line.substr(first, line.find_last_not_of(" \t\r") - first + 1)};
+            if (!collectScripts((entry.is_absolute() ? entry : base / entry).string(), scripts)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::error_code ec;
+    if (!fs::is_directory(arg, ec)) {
+        scripts.push_back(arg);
+        return true;
+    }
+
+    std::vector<std::string> found;
+    for (fs::recursive_directory_iterator it{arg, ec}, end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec) && it->path().extension() == ".lox") {
+            found.push_back(it->path().string());
+        }
+    }
+    if (ec) {
+        std::println(stderr, "Failed to list directory {}: {}", arg, ec.message());
+        return false;
+    }
+
+    std::ranges::sort(found);
+    scripts.insert(scripts.end(), found.begin(), found.end());
+    return true;
+}
+
+// An in-memory FILE* for one script's output. Where open_memstream is unavailable (or fails) it writes straight to
+// `fallback` instead, and batch output is no longer kept in script order.
+class CapturedStream {
+public:
+    explicit CapturedStream(std::FILE* fallback) {
+#if defined(__unix__) || defined(__APPLE__)
+        m_file = open_memstream(&m_data, &m_size);
+#endif
+        if (m_file == nullptr) {
+            m_file = fallback;
+            m_owned = false;
+        }
+    }
+
+    CapturedStream(const CapturedStream& other) = delete;
+    CapturedStream& operator=(const CapturedStream& other) = delete;
+
+    ~CapturedStream() {
+        if (m_owned) {
+            std::fclose(m_file);
+        }
+        std::free(m_data);
+    }
+
+    [[nodiscard]] std::FILE* file() const noexcept { return m_file; }
+
+    // Closes the stream and returns everything written to it.
+    [[nodiscard]] std::string take() {
+        if (!m_owned) {
+            return {};
+        }
+
+        std::fclose(m_file);
+        m_owned = false;
+        return {m_data, m_size};
+    }
+
+private:
+    std::FILE* m_file{nullptr};
+    char* m_data{nullptr};
+    std::size_t m_size{0};
+    bool m_owned{true};
+};
+
+struct ScriptResult {
+    std::string out;
+    std::string err;
+    int exitCode{0};
+    std::chrono::nanoseconds elapsed{0};
+    bool done{false};
+};
+
+static double toMillis(std::chrono::nanoseconds duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Nearest-rank percentile of an ascending list.
+static std::chrono::nanoseconds percentile(const std::vector<std::chrono::nanoseconds>& sorted, double p) {
+    auto rank = static_cast<std::size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+    return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+// Compiles and runs every script on `jobs` threads, each with its own Context configured like `settings`. Every
+// script's output is buffered and printed as soon as all scripts before it have finished, so stdout and stderr read
+// exactly as a sequential run would. The exit code is that of the first script that failed.
+static int runBatch(const Context& settings, const std::vector<std::string>& scripts, std::size_t jobs) {
+    jobs = std::clamp<std::size_t>(jobs, 1, std::max<std::size_t>(scripts.size(), 1));
+    std::vector<Context> contexts(jobs);
+    for (auto& ctx: contexts) {
+        ctx.optimizer.level = settings.optimizer.level;
+        ctx.vm.gcMode = settings.vm.gcMode;
+        ctx.vm.gcStress = settings.vm.gcStress;
+        ctx.vm.quickenStats = settings.vm.quickenStats;
+        ctx.vm.trace = settings.vm.trace;
+        ctx.dumpBytecode = settings.dumpBytecode;
+        ctx.useCache = settings.useCache;
+    }
+
+    std::vector<ScriptResult> results(scripts.size());
+    std::mutex printMutex;
+    std::size_t nextToPrint{0};
+
+    auto start = std::chrono::steady_clock::now();
+    parallelFor(scripts.size(), jobs, [&](std::size_t worker, std::size_t task) {
+        Context& ctx = contexts[worker];
+        ScriptResult result{};
+        {
+            CapturedStream out{stdout};
+            CapturedStream err{stderr};
+            ctx.vm.out = out.file();
+            ctx.vm.err = err.file();
+
+            auto scriptStart = std::chrono::steady_clock::now();
+            result.exitCode = runFile(ctx, scripts[task]);
+            result.elapsed = std::chrono::steady_clock::now() - scriptStart;
+
+            ctx.vm.out = stdout;
+            ctx.vm.err = stderr;
+            result.out = out.take();
+            result.err = err.take();
+        }
+
+        std::scoped_lock lock{printMutex};
+        results[task] = std::move(result);
+        results[task].done = true;
+        for (; nextToPrint < results.size() && results[nextToPrint].done; ++nextToPrint) {
+            auto& ready = results[nextToPrint];
+            std::fwrite(ready.out.data(), 1, ready.out.size(), stdout);
+            std::fwrite(ready.err.data(), 1, ready.err.size(), stderr);
+            std::fflush(stdout);
+            ready.out = {};
+            ready.err = {};
+        }
+    });
+    auto wall = std::chrono::steady_clock::now() - start;
+
+    int exitCode{0};
+    std::size_t failed{0};
+    std::vector<std::chrono::nanoseconds> latencies;
+    latencies.reserve(results.size());
+    for (const auto& result: results) {
+        latencies.push_back(result.elapsed);
+        if (result.exitCode != 0) {
+            ++failed;
+            exitCode = exitCode == 0 ? result.exitCode : exitCode;
+        }
+    }
+
+    std::ranges::sort(latencies);
+    std::println(stderr, "== batch ==");
+    std::println(stderr, "scripts: {}  failed: {}  jobs: {}  wall: {:.3f} ms  throughput: {:.1f} scripts/s",
+                 scripts.size(), failed, jobs, toMillis(wall),
+                 static_cast<double>(scripts.size()) / std::chrono::duration<double>(wall).count());
+    if (!latencies.empty()) {
+        std::println(stderr, "latency p50: {:.3f} ms  p99: {:.3f} ms  max: {:.3f} ms",
+                     toMillis(percentile(latencies, 50)), toMillis(percentile(latencies, 99)),
+                     toMillis(latencies.back()));
+    }
+    for (std::size_t i{0}; i < results.size(); ++i) {
+        if (results[i].exitCode != 0) {
+            std::println(stderr, "  exit {}: {}", results[i].exitCode, scripts[i]);
+        }
+    }
+
+    return exitCode;
+}
+
+static std::optional<std::size_t> parseJobs(std::string_view text) {
+    std::size_t jobs{0};
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), jobs);
+    if (ec != std::errc{} || end != text.data() + text.size() || jobs == 0) {
+        return std::nullopt;
+    }
+    return jobs;
+}
+
+auto main(int argc, const char* argv[]) -> int {
+    Context ctx{};
     int exitCode{0};
     std::span args(argv, static_cast<std::size_t>(argc));
+    std::vector<std::string> paths;
+    std::optional<std::string> outputPath;
+    bool compileOnly{false};
+    bool showGcStats{false};
+    bool showOptStats{false};
+    std::optional<std::string> sequenceStatsPath;
+    std::optional<std::string> profileJsonPath;
+    std::optional<std::size_t> jobs;
+    bool badJobs{false};
+
+    for (std::size_t i{1}; i < args.size(); ++i) {
+        std::string_view arg{args[i]};
+        if (arg == "--compile") {
+            compileOnly = true;
+        } else if (arg == "-o" && i + 1 < args.size()) {
+            outputPath = args[++i];
+        } else if (arg == "--gc-stress") {
+            ctx.vm.gcStress = true;
+        } else if (arg == "--gc-incremental") {
+            ctx.vm.gcMode = GcMode::incremental;
+        } else if (arg == "--trace") {
+            ctx.vm.trace = true;
+        } else if (arg == "--dump-bytecode") {
+            ctx.dumpBytecode = true;
+        } else if (arg == "--quicken-stats") {
+            ctx.vm.quickenStats = true;
+        } else if (arg == "--profile") {
+            ctx.vm.profile = true;
+        } else if (arg == "--profile-json" && i + 1 < args.size()) {
+            profileJsonPath = args[++i];
+            ctx.vm.profile = true;
+        } else if (arg == "--gc-stats") {
+            showGcStats = true;
+        } else if (arg == "--opt-stats") {
+            showOptStats = true;
+        } else if (arg == "--sequence-stats" && i + 1 < args.size()) {
+            sequenceStatsPath = args[++i];
+            ctx.optimizer.countSequences = true;
+        } else if (arg.starts_with("-O") && arg.size() == 3 && arg[2] >= '0' && arg[2] - '0' <= MAX_OPT_LEVEL) {
+            ctx.optimizer.level = arg[2] - '0';
+        } else if ((arg == "--jobs" || arg == "-j") && i + 1 < args.size()) {
+            jobs = parseJobs(args[++i]);
+            badJobs = !jobs;
+        } else {
+            paths.emplace_back(arg);
+        }
+    }
 
-    if (args.size() == 1) {
-        repl();
-    } else if (args.size() == 2) {
-        exitCode = runFile(args[1]);
+    // More than one script, a directory or a manifest runs as a batch; so does a single script given --jobs.
+    std::error_code ec;
+    bool batch = jobs || paths.size() > 1 ||
+                 (paths.size() == 1 &&
+                  (paths.front().starts_with('@') || std::filesystem::is_directory(paths.front(), ec)));
+
+    // These flags report on the compiler, so a cached chunk would leave them with nothing to show.
+    if (ctx.dumpBytecode || showOptStats || sequenceStatsPath) {
+        ctx.useCache = false;
+    }
+
+    // Usage errors return before the reports below: nothing ran, so they would only print empty tables.
+    if (badJobs) {
+        std::println(stderr, "--jobs expects a positive number of threads");
+        return 64;
+    } else if (compileOnly && paths.size() == 1) {
+        exitCode = compileFile(ctx, paths.front(), outputPath.value_or(cachePathFor(paths.front())));
+    } else if (compileOnly || outputPath) {
+        std::println(stderr, "Usage: clox [-O0|-O1|-O2] --compile path [-o output]");
+        return 64;
+    } else if (paths.empty()) {
+        repl(ctx);
+    } else if (!batch) {
+        exitCode = runFile(ctx, paths.front());
+    } else if (showGcStats || showOptStats || sequenceStatsPath || ctx.vm.profile) {
+        std::println(stderr, "Usage: clox [-O0|-O1|-O2] [--trace] [--dump-bytecode] [--opt-stats] "
+                             "[--sequence-stats out.tsv] [--gc-stress] [--gc-incremental] [--gc-stats] "
+                             "[--quicken-stats] [--profile] [--profile-json out.json] [path | file.loxc]");
+        std::println(stderr, "       clox [-O0|-O1|-O2] [--trace] [--dump-bytecode] [--gc-stress] [--gc-incremental] "
+                             "[--quicken-stats] [--jobs N] (path | directory | @manifest)...");
+        return 64;
     } else {
-        std::println(stderr, "Usage: clox [path]");
-        exitCode = 64;
+        std::vector<std::string> scripts;
+        auto collect = [&](const std::string& path) { return collectScripts(path, scripts); };
+        std::size_t threads = jobs.value_or(std::max(1u, std::thread::hardware_concurrency()));
+        exitCode = std::ranges::all_of(paths, collect) ? runBatch(ctx, scripts, threads) : 66;
+    }
+
+    if (showGcStats) {
+        printGcStats(ctx.vm);
+    }
+
+    if (showOptStats) {
+        printOptimizerStats(ctx.optimizer);
+    }
+
+    // --compile only compiles, so there is nothing to profile.
+    if (ctx.vm.profile && !compileOnly) {
+        printProfile(stderr, ctx.vm.profiler);
+    }
+
+    if (profileJsonPath && !compileOnly && !writeProfileJson(ctx.vm.profiler, *profileJsonPath) && exitCode == 0) {
+        exitCode = 74;
+    }
+
+    if (sequenceStatsPath && !writeSequenceCounts(ctx.optimizer, *sequenceStatsPath) && exitCode == 0) {
+        exitCode = 74;
     }
 
-    freeVM();
     return exitCode;
 }
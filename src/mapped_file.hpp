@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Read-only, private memory mapping of a whole file. The contents are not NUL-terminated; consumers must respect
+// size().
+class MappedFile {
+public:
+    // Returns nullopt when the file cannot be opened or mapped (pipes, special files, non-POSIX platforms).
+    [[nodiscard]] static std::optional<MappedFile> open(const std::string& path);
+
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    [[nodiscard]] constexpr const char* data() const noexcept { return static_cast<const char*>(m_data); }
+    [[nodiscard]] constexpr std::size_t size() const noexcept { return m_size; }
+    [[nodiscard]] constexpr std::string_view view() const noexcept { return {data(), m_size}; }
+
+private:
+    MappedFile(void* data, std::size_t size) : m_data{data}, m_size{size} {}
+
+    void* m_data{nullptr};
+    std::size_t m_size{0};
+};
@@ -0,0 +1,101 @@
+#include "memory.hpp"
+#include <cstdlib>
+#include <new>
+
+static constexpr std::size_t alignUp(std::size_t size, std::size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+Arena::Block* Arena::newBlock(std::size_t payload) {
+    auto* block = static_cast<Block*>(std::malloc(HEADER_SIZE + payload));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    block->next = nullptr;
+    block->prev = nullptr;
+    m_mallocCount++;
+    return block;
+}
+
+void* Arena::allocateLarge(std::size_t size) {
+    Block* block = newBlock(size);
+    block->next = m_largeBlocks;
+    if (m_largeBlocks != nullptr) {
+        m_largeBlocks->prev = block;
+    }
+    m_largeBlocks = block;
+
+    return reinterpret_cast<char*>(block) + HEADER_SIZE;
+}
+
+void* Arena::allocate(std::size_t size) {
+    size = alignUp(size == 0 ? 1 : size, ALIGNMENT);
+    m_allocationCount++;
+    m_bytesAllocated += size;
+
+    if (size > LARGE_SIZE) {
+        return allocateLarge(size);
+    }
+
+    FreeSlot*& freeSlot = m_freeSlots[size / ALIGNMENT - 1];
+    if (freeSlot != nullptr) {
+        void* result = freeSlot;
+        freeSlot = freeSlot->next;
+        return result;
+    }
+
+    if (m_cursor == nullptr || static_cast<std::size_t>(m_limit - m_cursor) < size) {
+        Block* block = newBlock(BLOCK_SIZE);
+        block->next = m_blocks;
+        m_blocks = block;
+        m_cursor = reinterpret_cast<char*>(block) + HEADER_SIZE;
+        m_limit = m_cursor + BLOCK_SIZE;
+    }
+
+    void* result = m_cursor;
+    m_cursor += size;
+    return result;
+}
+
+void Arena::deallocate(void* pointer, std::size_t size) noexcept {
+    size = alignUp(size == 0 ? 1 : size, ALIGNMENT);
+    m_bytesAllocated -= size;
+
+    if (size > LARGE_SIZE) {
+        auto* block = reinterpret_cast<Block*>(static_cast<char*>(pointer) - HEADER_SIZE);
+        if (block->prev != nullptr) {
+            block->prev->next = block->next;
+        } else {
+            m_largeBlocks = block->next;
+        }
+        if (block->next != nullptr) {
+            block->next->prev = block->prev;
+        }
+
+        std::free(block);
+        return;
+    }
+
+    auto* slot = static_cast<FreeSlot*>(pointer);
+    FreeSlot*& freeSlot = m_freeSlots[size / ALIGNMENT - 1];
+    slot->next = freeSlot;
+    freeSlot = slot;
+}
+
+void Arena::freeAll() noexcept {
+    for (Block* list: {m_blocks, m_largeBlocks}) {
+        while (list != nullptr) {
+            Block* next = list->next;
+            std::free(list);
+            list = next;
+        }
+    }
+
+    m_blocks = nullptr;
+    m_largeBlocks = nullptr;
+    m_cursor = nullptr;
+    m_limit = nullptr;
+    m_freeSlots.fill(nullptr);
+    m_bytesAllocated = 0;
+}
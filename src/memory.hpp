@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Bump allocator owned by the VM. Small objects are carved out of large blocks; when the collector frees one, its
+// slot goes onto a free list for its size class and is reused by the next allocation of that size. Requests too big
+// for a block get their own allocation. freeAll() releases everything at once.
+class Arena {
+public:
+    constexpr Arena() = default;
+    Arena(const Arena& other) = delete;
+    Arena& operator=(const Arena& other) = delete;
+
+    [[nodiscard]] void* allocate(std::size_t size);
+    void deallocate(void* pointer, std::size_t size) noexcept;
+    void freeAll() noexcept;
+
+    // Number of times the arena went to malloc for a new block.
+    [[nodiscard]] constexpr std::size_t mallocCount() const noexcept { return m_mallocCount; }
+    // Number of allocations handed out since the arena was created.
+    [[nodiscard]] constexpr std::size_t allocationCount() const noexcept { return m_allocationCount; }
+    // Bytes currently handed out and not yet deallocated.
+    [[nodiscard]] constexpr std::size_t bytesAllocated() const noexcept { return m_bytesAllocated; }
+
+private:
+    static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+    static constexpr std::size_t LARGE_SIZE = BLOCK_SIZE / 4;
+    static constexpr std::size_t ALIGNMENT = alignof(std::max_align_t);
+
+    struct Block {
+        Block* next;
+        Block* prev;
+    };
+
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    static constexpr std::size_t HEADER_SIZE = (sizeof(Block) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    Block* m_blocks{nullptr};
+    Block* m_largeBlocks{nullptr};
+    char* m_cursor{nullptr};
+    char* m_limit{nullptr};
+    std::array<FreeSlot*, LARGE_SIZE / ALIGNMENT> m_freeSlots{};
+    std::size_t m_mallocCount{0};
+    std::size_t m_allocationCount{0};
+    std::size_t m_bytesAllocated{0};
+
+    Block* newBlock(std::size_t payload);
+    void* allocateLarge(std::size_t size);
+};
+
+// Constructs a T in arena memory followed by `extraBytes` of trailing storage.
+template<typename T, typename... Args>
+T* allocateObj(Arena& arena, std::size_t extraBytes, Args&&... args) {
+    void* memory = arena.allocate(sizeof(T) + extraBytes);
+    return ::new (memory) T(std::forward<Args>(args)...);
+}
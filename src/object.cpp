@@ -1,56 +1,167 @@
 #include "object.hpp"
+#include <algorithm>
 #include <cstring>
 #include <print>
+#include <string>
+#include <vector>
 #include "forward_decl.hpp"
+#include "gc.hpp"
 #include "inline_decl.hpp"
+#include "memory.hpp"
 #include "value.hpp"
+#include "vm.hpp"
 
-ObjString::ObjString(std::string_view str) : Obj(ObjType::obj_string), m_length(str.size()) {
-    if (isSmallString()) {
-        std::memcpy(m_ssoString.data(), str.data(), m_length);
-        m_ssoString[m_length] = '\0';
-    } else {
-        m_chars = std::make_unique<char[]>(m_length + 1);
-        std::memcpy(m_chars.get(), str.data(), m_length);
-        m_chars[m_length] = '\0';
+// Every heap object is created here: it gives the collector a chance to run first, then links the new object into
+// vm.objects so the sweep phase can find it.
+template<typename T, typename... Args>
+static T* allocateObject(VM& vm, std::size_t extraBytes, Args&&... args) {
+    maybeCollectGarbage(vm, sizeof(T) + extraBytes);
+
+    T* object = allocateObj<T>(vm.arena, extraBytes, std::forward<Args>(args)...);
+    // Objects born while an incremental cycle is still marking are allocated black so that cycle keeps them.
+    object->setMarked(vm.gcPhase == GcPhase::mark || vm.gcPhase == GcPhase::sweep_strings);
+    object->setNext(vm.objects);
+    vm.objects = object;
+    return object;
+}
+
+static ObjString* allocateString(VM& vm, std::size_t length, uint32_t hash) {
+    auto* string = allocateObject<ObjString>(vm, length + 1, length, hash);
+    string->data()[length] = '\0';
+    vm.strings.set(string, nilValue());
+    return string;
+}
+
+ObjString* copyString(VM& vm, const char* chars, int length) {
+    std::string_view view{chars, static_cast<std::size_t>(length)};
+    uint32_t hash = hashString(view);
+    if (ObjString* interned = vm.strings.findString(view, hash)) {
+        writeBarrier(vm, objValue(interned));
+        return interned;
+    }
+
+    ObjString* string = allocateString(vm, view.size(), hash);
+    std::memcpy(string->data(), view.data(), view.size());
+    return string;
+}
+
+ObjString* concatenateStrings(VM& vm, std::string_view a, std::string_view b) {
+    uint32_t hash = hashString(b, hashString(a));
+    if (ObjString* interned = vm.strings.findString(a, b, hash)) {
+        writeBarrier(vm, objValue(interned));
+        return interned;
     }
+
+    ObjString* string = allocateString(vm, a.size() + b.size(), hash);
+    std::memcpy(string->data(), a.data(), a.size());
+    std::memcpy(string->data() + a.size(), b.data(), b.size());
+    return string;
 }
 
-ObjString::ObjString(const ObjString& other) : Obj(ObjType::obj_string), m_length(other.m_length) {
-    if (isSmallString()) {
-        std::memcpy(m_ssoString.data(), other.m_ssoString.data(), m_length + 1);
-    } else {
-        m_chars = std::make_unique<char[]>(m_length + 1);
-        std::memcpy(m_chars.get(), other.m_chars.get(), m_length + 1);
+Value stringValue(VM& vm, std::string_view chars) {
+    if (ShortString::fits(chars)) {
+        return shortStringValue(chars);
+    }
+    return objValue(copyString(vm, chars.data(), static_cast<int>(chars.size())));
+}
+
+static std::size_t stringLength(Value value) {
+    if (isShortString(value)) {
+        return asShortString(value).length();
+    }
+    if (isObjRope(value)) {
+        return asObjRope(value)->getLength();
     }
+    return asObjString(value)->getLength();
 }
 
-ObjString& ObjString::operator=(const ObjString& other) {
-    if (this != &other) {
-        m_length = other.m_length;
-        if (isSmallString()) {
-            std::memcpy(m_ssoString.data(), other.m_ssoString.data(), m_length + 1);
+// A rope that has already been flattened stands for its flat string, which keeps new ropes shallow.
+static Value resolveRope(Value value) {
+    if (isObjRope(value)) {
+        if (ObjString* flat = asObjRope(value)->getFlat()) {
+            return objValue(flat);
+        }
+    }
+    return value;
+}
+
+// The characters of a short string or ObjString. A short string's are copied into `buffer`, which must outlive the
+// returned view.
+static std::string_view stringChars(Value value, ShortStringBuffer& buffer) {
+    return isShortString(value) ? asShortString(value).unpack(buffer) : asStringView(value);
+}
+
+// Calls `piece` with each string a rope is made of, left to right. Iterative because ropes built by a long chain of
+// `+` are as deep as the chain is long.
+template<typename F>
+static void forEachPiece(const ObjRope* rope, F&& piece) {
+    std::vector<Value> pending{rope->getRight(), rope->getLeft()};
+    while (!pending.empty()) {
+        Value node = resolveRope(pending.back());
+        pending.pop_back();
+        if (isObjRope(node)) {
+            pending.push_back(asObjRope(node)->getRight());
+            pending.push_back(asObjRope(node)->getLeft());
         } else {
-            m_chars = std::make_unique<char[]>(m_length + 1);
-            std::memcpy(m_chars.get(), other.m_chars.get(), m_length + 1);
+            ShortStringBuffer buffer;
+            piece(stringChars(node, buffer));
         }
     }
+}
 
-    return *this;
+Value joinStrings(VM& vm, Value a, Value b) {
+    a = resolveRope(a);
+    b = resolveRope(b);
+    std::size_t length = stringLength(a) + stringLength(b);
+    if (length >= ROPE_MIN_LENGTH) {
+        ObjRope* rope = allocateObject<ObjRope>(vm, 0, a, b, length);
+        // The rope may have been allocated black, and its children are about to leave the stack.
+        writeBarrier(vm, a);
+        writeBarrier(vm, b);
+        return objValue(rope);
+    }
+
+    // Every rope is at least ROPE_MIN_LENGTH long, so both operands are short strings or ObjStrings here.
+    ShortStringBuffer leftBuffer;
+    ShortStringBuffer rightBuffer;
+    std::string_view left = stringChars(a, leftBuffer);
+    std::string_view right = stringChars(b, rightBuffer);
+    if (length <= SHORT_STRING_MAX) {
+        ShortStringBuffer joined{};
+        std::ranges::copy(right, std::ranges::copy(left, joined.begin()).out);
+        return stringValue(vm, {joined.data(), length});
+    }
+    return objValue(concatenateStrings(vm, left, right));
 }
 
-std::unique_ptr<ObjString> copyString(const char* chars, int length) {
-    auto heapChars = std::make_unique<char[]>(length + 1);
-    std::memcpy(heapChars.get(), chars, length);
-    heapChars[length] = '\0';
+ObjString* flattenRope(VM& vm, ObjRope* rope) {
+    if (rope->getFlat() != nullptr) {
+        return rope->getFlat();
+    }
+
+    std::string chars;
+    chars.reserve(rope->getLength());
+    forEachPiece(rope, [&](std::string_view piece) { chars += piece; });
 
-    return std::make_unique<ObjString>(std::string_view(heapChars.get(), length));
+    // Interning hashes the flattened text; the rope keeps its children alive until it has the result.
+    ObjString* flat = copyString(vm, chars.data(), static_cast<int>(chars.size()));
+    rope->setFlat(flat);
+    return flat;
 }
 
-void printObj(const Value& value) {
+void printObj(std::FILE* out, const Value& value) {
     switch (asObj(value)->getType()) {
         case ObjType::obj_string:
-            std::print("{}", asCString(value));
+            std::print(out, "{}", asCString(value));
+            break;
+        case ObjType::obj_rope:
+            // The VM flattens a rope before printing it as a result; only --trace sees unflattened ones, and printing
+            // them piece by piece keeps tracing from allocating.
+            if (ObjString* flat = asObjRope(value)->getFlat()) {
+                std::print(out, "{}", flat->getChars());
+            } else {
+                forEachPiece(asObjRope(value), [&](std::string_view piece) { std::print(out, "{}", piece); });
+            }
             break;
     }
 }
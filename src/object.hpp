@@ -1,51 +1,120 @@
 #pragma once
 
-#include <array>
 #include <cstddef>
-#include <memory>
+#include <cstdint>
+#include <cstdio>
 #include <string_view>
+#include <type_traits>
 #include "forward_decl.hpp"
+#include "value.hpp"
 
+// The 16-byte header every heap object starts with: the link in the VM's object list, the type, GC flags and a
+// 32-bit hash that strings use. There is no vtable; code that needs the concrete type switches on getType(), and
+// every object type is trivially destructible so freeing one only returns its bytes to the arena.
 class Obj {
 public:
     constexpr ObjType getType() const noexcept { return m_type; }
-    virtual ~Obj() = default;
+    constexpr bool isMarked() const noexcept { return (m_flags & FLAG_MARKED) != 0; }
+    constexpr void setMarked(bool marked) noexcept {
+        m_flags = static_cast<uint8_t>(marked ? m_flags | FLAG_MARKED : m_flags & ~FLAG_MARKED);
+    }
+    constexpr Obj* getNext() const noexcept { return m_next; }
+    constexpr void setNext(Obj* next) noexcept { m_next = next; }
 
 protected:
-    explicit Obj(ObjType t) : m_type{t} {}
+    explicit Obj(ObjType t, uint32_t hash = 0) : m_type{t}, m_hash{hash} {}
+
+    constexpr uint32_t headerHash() const noexcept { return m_hash; }
 
 private:
-    ObjType m_type{};
+    static constexpr uint8_t FLAG_MARKED = 1;
+
     Obj* m_next{nullptr};
+    ObjType m_type{};
+    uint8_t m_flags{0};
+    uint32_t m_hash{0};
 };
 
+static_assert(sizeof(Obj) == 16, "The object header must stay two words.");
+
+// Strings are a single arena allocation: the header is immediately followed by `m_length` characters and a
+// terminating '\0'. Every string is interned in VM::strings, so two strings are equal exactly when their pointers are.
+// Strings that fit in a ShortString are never ObjStrings; stringValue() keeps that true.
 class ObjString : public Obj {
 public:
-    explicit ObjString(std::string_view str);
-    ~ObjString() override = default;
-    ObjString(const ObjString& other);
-    ObjString(ObjString&& other) noexcept = default;
-    ObjString& operator=(const ObjString& other);
-    ObjString& operator=(ObjString&& other) noexcept = default;
+    ObjString(std::size_t length, uint32_t hash) : Obj(ObjType::obj_string, hash), m_length(length) {}
+    ObjString(const ObjString& other) = delete;
+    ObjString& operator=(const ObjString& other) = delete;
 
     constexpr size_t getLength() const noexcept { return m_length; }
+    constexpr uint32_t getHash() const noexcept { return headerHash(); }
+    std::string_view getChars() const noexcept { return {getCString(), m_length}; }
+    const char* getCString() const noexcept { return reinterpret_cast<const char*>(this + 1); }
+    char* data() noexcept { return reinterpret_cast<char*>(this + 1); }
 
-    constexpr auto getChars() const noexcept {
-        return isSmallString() ? std::string_view(m_ssoString.data(), m_length)
-                               : std::string_view(m_chars.get(), m_length);
-    }
+private:
+    std::size_t m_length{0};
+};
 
-    constexpr const char* getCString() const noexcept { return isSmallString() ? m_ssoString.data() : m_chars.get(); }
+static_assert(sizeof(ObjString) == 24, "ObjString is the header plus its length; the characters follow it.");
+static_assert(std::is_trivially_destructible_v<ObjString>, "freeObject() never runs destructors.");
 
-private:
-    static constexpr auto SSO_THRESHOLD = 23;
+// A string built by `add` without copying: the concatenation of `left` and `right`, each a short string, an ObjString
+// or another ObjRope. Ropes are not interned. The first time one is printed or compared it is flattened into an
+// interned ObjString, which it keeps in `flat`; the children are dropped then so the collector can reclaim them.
+class ObjRope : public Obj {
+public:
+    ObjRope(Value left, Value right, std::size_t length) :
+        Obj(ObjType::obj_rope), m_left(left), m_right(right), m_length(length) {}
+    ObjRope(const ObjRope& other) = delete;
+    ObjRope& operator=(const ObjRope& other) = delete;
 
-    std::size_t m_length{0};
-    std::unique_ptr<char[]> m_chars{nullptr};
-    std::array<char, SSO_THRESHOLD + 1> m_ssoString;
+    constexpr std::size_t getLength() const noexcept { return m_length; }
+    constexpr Value getLeft() const noexcept { return m_left; }
+    constexpr Value getRight() const noexcept { return m_right; }
+    constexpr ObjString* getFlat() const noexcept { return m_flat; }
+    constexpr void setFlat(ObjString* flat) noexcept {
+        m_flat = flat;
+        m_left = Value{};
+        m_right = Value{};
+    }
 
-    constexpr bool isSmallString() const noexcept { return m_length <= SSO_THRESHOLD; }
+private:
+    Value m_left{};
+    Value m_right{};
+    std::size_t m_length{0};
+    ObjString* m_flat{nullptr};
 };
 
-std::unique_ptr<ObjString> copyString(const char* chars, int length);
-void printObj(const Value& value);
+static_assert(sizeof(ObjRope) == sizeof(Obj) + 2 * sizeof(Value) + 2 * sizeof(void*),
+              "ObjRope is the header, its two halves, its length and its flat string.");
+static_assert(std::is_trivially_destructible_v<ObjRope>, "freeObject() never runs destructors.");
+
+// Concatenations shorter than this are copied into an interned string; a rope node would cost about as much memory
+// and make every later comparison pay for flattening.
+inline constexpr std::size_t ROPE_MIN_LENGTH = 64;
+
+// FNV-1a. Passing a previous result as `hash` continues it, so hash(a + b) == hashString(b, hashString(a)).
+inline constexpr uint32_t FNV_OFFSET_BASIS = 2166136261u;
+inline constexpr uint32_t FNV_PRIME = 16777619u;
+
+constexpr uint32_t hashString(std::string_view chars, uint32_t hash = FNV_OFFSET_BASIS) {
+    for (char c: chars) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+ObjString* copyString(VM& vm, const char* chars, int length);
+ObjString* concatenateStrings(VM& vm, std::string_view a, std::string_view b);
+// A short string if `chars` fits in one, otherwise the interned ObjString.
+Value stringValue(VM& vm, std::string_view chars);
+// Concatenates two strings of any kind: results that fit become short strings, other short results are copied and
+// interned, and longer ones become an ObjRope. `a` and `b` must be reachable by the collector (on the VM stack) until
+// this returns.
+Value joinStrings(VM& vm, Value a, Value b);
+// The interned string equal to `rope`, flattening it on first use. `rope` must be reachable by the collector.
+ObjString* flattenRope(VM& vm, ObjRope* rope);
+void printObj(std::FILE* out, const Value& value);
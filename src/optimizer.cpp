@@ -0,0 +1,414 @@
+#include "optimizer.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <print>
+#include <unordered_map>
+#include <vector>
+#include "inline_decl.hpp"
+
+namespace {
+    // Decoded form of one instruction. Loads are normalised to `constant` with a full-width pool index; the encoder
+    // picks the short or long form again once the pool has been compacted.
+    struct Instruction {
+        OpCode op;
+        uint32_t operand;
+        int line;
+    };
+
+    std::vector<Instruction> decode(const Chunk& chunk) {
+        std::vector<Instruction> instructions;
+        const auto& code = chunk.code;
+        for (std::size_t offset{0}; offset < code.size();) {
+            auto op = static_cast<OpCode>(code[offset]);
+            int line = chunk.getLine(offset);
+            uint32_t operand{0};
+            if (op == OpCode::constant) {
+                operand = code[offset + 1];
+            } else if (op == OpCode::constant_long) {
+                operand = static_cast<uint32_t>(code[offset + 1] | (code[offset + 2] << 8) | (code[offset + 3] << 16));
+                op = OpCode::constant;
+            }
+
+            instructions.push_back({op, operand, line});
+            offset += instructionSize(static_cast<OpCode>(code[offset]));
+        }
+
+        return instructions;
+    }
+
+    std::optional<Value> loadedValue(const Chunk& chunk, const Instruction& instruction) {
+        switch (instruction.op) {
+            case OpCode::constant:
+                return chunk.constants.values[instruction.operand];
+            case OpCode::nil:
+                return nilValue();
+            case OpCode::op_true:
+                return boolValue(true);
+            case OpCode::op_false:
+                return boolValue(false);
+            default:
+                return std::nullopt;
+        }
+    }
+
+    std::optional<Instruction> loadOf(VM& vm, Chunk& chunk, Value value, int line) {
+        if (isNil(value)) {
+            return Instruction{OpCode::nil, 0, line};
+        }
+        if (isBool(value)) {
+            return Instruction{asBool(value) ? OpCode::op_true : OpCode::op_false, 0, line};
+        }
+        if (chunk.constants.count() >= MAX_CONSTANTS) {
+            return std::nullopt;
+        }
+
+        return Instruction{OpCode::constant, static_cast<uint32_t>(chunk.addConstant(vm, value)), line};
+    }
+
+    // Folding must agree with VM::run exactly, and must leave anything that would raise a runtime error (or allocate,
+    // like string concatenation) for the VM to do.
+    std::optional<Value> foldUnary(OpCode op, Value operand) {
+        switch (op) {
+            case OpCode::op_not:
+                return boolValue(isFalsey(operand));
+            case OpCode::negate:
+                if (isNumber(operand)) {
+                    return numberValue(-asNumber(operand));
+                }
+                return std::nullopt;
+            default:
+                return std::nullopt;
+        }
+    }
+
+    std::optional<Value> foldBinary(OpCode op, Value a, Value b) {
+        if (op == OpCode::equal || op == OpCode::not_equal) {
+            return boolValue(valuesEq(a, b) == (op == OpCode::equal));
+        }
+        if (!isNumber(a) || !isNumber(b)) {
+            return std::nullopt;
+        }
+
+        double x = asNumber(a);
+        double y = asNumber(b);
+        switch (op) {
+            case OpCode::add:
+                return numberValue(x + y);
+            case OpCode::subtract:
+                return numberValue(x - y);
+            case OpCode::multiply:
+                return numberValue(x * y);
+            case OpCode::divide:
+                return numberValue(x / y);
+            case OpCode::greater:
+                return boolValue(x > y);
+            case OpCode::less:
+                return boolValue(x < y);
+            case OpCode::greater_equal:
+                return boolValue(!(x < y));
+            case OpCode::less_equal:
+                return boolValue(!(x > y));
+            default:
+                return std::nullopt;
+        }
+    }
+
+    std::optional<OpCode> negatedComparison(OpCode op) {
+        switch (op) {
+            case OpCode::equal:
+                return OpCode::not_equal;
+            case OpCode::not_equal:
+                return OpCode::equal;
+            case OpCode::less:
+                return OpCode::greater_equal;
+            case OpCode::greater_equal:
+                return OpCode::less;
+            case OpCode::greater:
+                return OpCode::less_equal;
+            case OpCode::less_equal:
+                return OpCode::greater;
+            default:
+                return std::nullopt;
+        }
+    }
+
+    bool producesBool(const Chunk& chunk, const Instruction& instruction) {
+        if (negatedComparison(instruction.op) || instruction.op == OpCode::op_not) {
+            return true;
+        }
+        auto value = loadedValue(chunk, instruction);
+        return value && isBool(*value);
+    }
+
+    // `add` is absent on purpose: it may produce a string.
+    bool producesNumber(const Chunk& chunk, const Instruction& instruction) {
+        switch (instruction.op) {
+            case OpCode::subtract:
+            case OpCode::multiply:
+            case OpCode::divide:
+            case OpCode::negate:
+                return true;
+            default: {
+                auto value = loadedValue(chunk, instruction);
+                return value && isNumber(*value);
+            }
+        }
+    }
+
+    bool isBinary(OpCode op) {
+        switch (op) {
+            case OpCode::equal:
+            case OpCode::not_equal:
+            case OpCode::greater:
+            case OpCode::greater_equal:
+            case OpCode::less:
+            case OpCode::less_equal:
+            case OpCode::add:
+            case OpCode::subtract:
+            case OpCode::multiply:
+            case OpCode::divide:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Tries one rewrite on the end of `out`, which always holds the optimised prefix of the chunk. Expressions are
+    // emitted in postfix order, so an operator's operands are exactly the instructions just before it. This relies on
+    // the code being straight-line: once jumps exist, rewrites must not reach across a jump target.
+    bool rewriteTail(VM& vm, Chunk& chunk, std::vector<Instruction>& out, int level) {
+        std::size_t n = out.size();
+        if (n < 2) {
+            return false;
+        }
+
+        Instruction& last = out[n - 1];
+        Instruction& prev = out[n - 2];
+
+        if (last.op == OpCode::op_not) {
+            if (auto negated = negatedComparison(prev.op)) {
+                prev.op = *negated;
+                out.pop_back();
+                return true;
+            }
+            if (prev.op == OpCode::op_not && n >= 3 && producesBool(chunk, out[n - 3])) {
+                out.resize(n - 2);
+                return true;
+            }
+        }
+
+        if (last.op == OpCode::negate && prev.op == OpCode::negate && n >= 3 && producesNumber(chunk, out[n - 3])) {
+            out.resize(n - 2);
+            return true;
+        }
+
+        if (level < 2) {
+            return false;
+        }
+
+        if (auto operand = loadedValue(chunk, prev)) {
+            if (auto folded = foldUnary(last.op, *operand)) {
+                if (auto load = loadOf(vm, chunk, *folded, prev.line)) {
+                    out.resize(n - 2);
+                    out.push_back(*load);
+                    return true;
+                }
+            }
+        }
+
+        if (n >= 3 && isBinary(last.op)) {
+            auto a = loadedValue(chunk, out[n - 3]);
+            auto b = loadedValue(chunk, prev);
+            if (a && b) {
+                if (auto folded = foldBinary(last.op, *a, *b)) {
+                    if (auto load = loadOf(vm, chunk, *folded, out[n - 3].line)) {
+                        out.resize(n - 3);
+                        out.push_back(*load);
+                        return true;
+                    }
+                }
+            }
+        }
+
+        return false;
+    }
+
+    // Rebuilds the pool with only the constants `instructions` still load, renumbering operands to match.
+    void compactConstants(VM& vm, Chunk& chunk, std::vector<Instruction>& instructions) {
+        std::vector<Value> old = std::move(chunk.constants.values);
+        chunk.constants.values.clear();
+        chunk.numberConstants.clear();
+        chunk.objectConstants.clear();
+        chunk.shortStringConstants.clear();
+
+        std::unordered_map<uint32_t, uint32_t> remap;
+        for (auto& instruction: instructions) {
+            if (instruction.op != OpCode::constant) {
+                continue;
+            }
+
+            auto [it, inserted] = remap.try_emplace(instruction.operand, 0);
+            if (inserted) {
+                it->second = static_cast<uint32_t>(chunk.addConstant(vm, old[instruction.operand]));
+            }
+            instruction.operand = it->second;
+        }
+    }
+
+    void recordSequences(SequenceCounts& counts, const std::vector<Instruction>& instructions) {
+        counts.pairs.resize(BASE_OPCODE_COUNT * BASE_OPCODE_COUNT);
+        counts.triples.resize(BASE_OPCODE_COUNT * BASE_OPCODE_COUNT * BASE_OPCODE_COUNT);
+
+        for (std::size_t i{0}; i + 1 < instructions.size(); ++i) {
+            auto a = static_cast<std::size_t>(instructions[i].op);
+            auto b = static_cast<std::size_t>(instructions[i + 1].op);
+            counts.pairs[a * BASE_OPCODE_COUNT + b]++;
+            if (i + 2 < instructions.size()) {
+                auto c = static_cast<std::size_t>(instructions[i + 2].op);
+                counts.triples[(a * BASE_OPCODE_COUNT + b) * BASE_OPCODE_COUNT + c]++;
+            }
+        }
+    }
+
+    // Superinstruction parts only have room for one-byte constant operands.
+    bool fusable(const Instruction& instruction) {
+        return instruction.op != OpCode::constant || instruction.operand <= std::numeric_limits<uint8_t>::max();
+    }
+
+    // Longest superinstruction whose parts match the instructions starting at `start`, if any.
+    const Superinstruction* matchSuperinstruction(const std::vector<Instruction>& instructions, std::size_t start) {
+        const Superinstruction* best{nullptr};
+        for (const auto& fused: SUPERINSTRUCTIONS) {
+            if (start + fused.length > instructions.size() || (best != nullptr && best->length >= fused.length)) {
+                continue;
+            }
+
+            bool matches{true};
+            for (std::size_t i{0}; i < fused.length && matches; ++i) {
+                matches = instructions[start + i].op == fused.parts[i] && fusable(instructions[start + i]);
+            }
+            if (matches) {
+                best = &fused;
+            }
+        }
+
+        return best;
+    }
+
+    void writeOperands(Chunk& chunk, const Instruction& instruction) {
+        if (instruction.op == OpCode::constant) {
+            chunk.writeChunk(static_cast<uint8_t>(instruction.operand), instruction.line);
+        }
+    }
+
+    // Returns the number of dispatches in the encoded chunk, counting each superinstruction once.
+    std::size_t encode(Chunk& chunk, const std::vector<Instruction>& instructions, bool fuse) {
+        chunk.code.clear();
+        chunk.freeLines();
+        std::size_t count{0};
+        for (std::size_t i{0}; i < instructions.size(); ++count) {
+            if (const Superinstruction* fused = fuse ? matchSuperinstruction(instructions, i) : nullptr) {
+                chunk.writeChunk(static_cast<uint8_t>(fused->op), instructions[i].line);
+                for (std::size_t part{0}; part < fused->length; ++part) {
+                    writeOperands(chunk, instructions[i + part]);
+                }
+                i += fused->length;
+                continue;
+            }
+
+            const auto& instruction = instructions[i++];
+            if (instruction.op != OpCode::constant) {
+                chunk.writeChunk(static_cast<uint8_t>(instruction.op), instruction.line);
+            } else if (instruction.operand <= std::numeric_limits<uint8_t>::max()) {
+                chunk.writeChunk(static_cast<uint8_t>(OpCode::constant), instruction.line);
+                chunk.writeChunk(static_cast<uint8_t>(instruction.operand), instruction.line);
+            } else {
+                chunk.writeChunk(static_cast<uint8_t>(OpCode::constant_long), instruction.line);
+                chunk.writeChunk(static_cast<uint8_t>(instruction.operand & 0xff), instruction.line);
+                chunk.writeChunk(static_cast<uint8_t>((instruction.operand >> 8) & 0xff), instruction.line);
+                chunk.writeChunk(static_cast<uint8_t>((instruction.operand >> 16) & 0xff), instruction.line);
+            }
+        }
+
+        return count;
+    }
+} // namespace
+
+void optimizeChunk(VM& vm, OptimizerState& state, Chunk& chunk) {
+    auto instructions = decode(chunk);
+    state.stats.chunks++;
+    state.stats.instructionsBefore += instructions.size();
+    if (state.level <= 0) {
+        if (state.countSequences) {
+            recordSequences(state.sequences, instructions);
+        }
+        state.stats.instructionsAfter += instructions.size();
+        state.stats.dispatchesAfter += instructions.size();
+        return;
+    }
+
+    std::vector<Instruction> out;
+    out.reserve(instructions.size());
+    for (const auto& instruction: instructions) {
+        out.push_back(instruction);
+        while (rewriteTail(vm, chunk, out, state.level)) {
+        }
+    }
+
+    if (state.countSequences) {
+        recordSequences(state.sequences, out);
+    }
+
+    compactConstants(vm, chunk, out);
+    state.stats.instructionsAfter += out.size();
+    state.stats.dispatchesAfter += encode(chunk, out, true);
+}
+
+void printOptimizerStats(const OptimizerState& state) {
+    const OptimizerStats& stats = state.stats;
+    std::println(stderr, "== optimizer (-O{}) ==", state.level);
+    std::println(stderr, "chunks: {}  instructions: {} -> {}  eliminated: {}", stats.chunks, stats.instructionsBefore,
+                 stats.instructionsAfter, stats.eliminated());
+    std::println(stderr, "dispatches: {}  fused away: {}", stats.dispatchesAfter, stats.fused());
+}
+
+bool writeSequenceCounts(const OptimizerState& state, const std::string& path) {
+    struct Row {
+        uint64_t count;
+        std::string ops;
+    };
+
+    std::vector<Row> rows;
+    const auto& counts = state.sequences;
+    for (std::size_t i{0}; i < counts.pairs.size(); ++i) {
+        if (counts.pairs[i] != 0) {
+            rows.push_back({counts.pairs[i], std::format("{} {}", OPCODE_NAMES[i / BASE_OPCODE_COUNT],
+                                                         OPCODE_NAMES[i % BASE_OPCODE_COUNT])});
+        }
+    }
+    for (std::size_t i{0}; i < counts.triples.size(); ++i) {
+        if (counts.triples[i] != 0) {
+            std::size_t ab = i / BASE_OPCODE_COUNT;
+            rows.push_back({counts.triples[i],
+                            std::format("{} {} {}", OPCODE_NAMES[ab / BASE_OPCODE_COUNT],
+                                        OPCODE_NAMES[ab % BASE_OPCODE_COUNT], OPCODE_NAMES[i % BASE_OPCODE_COUNT])});
+        }
+    }
+    std::ranges::stable_sort(rows, std::greater<>(), &Row::count);
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        std::println(stderr, "Failed to open file for writing: {}", path);
+        return false;
+    }
+
+    for (const auto& row: rows) {
+        file << std::format("{}\t{}\n", row.count, row.ops);
+    }
+    return static_cast<bool>(file);
+}
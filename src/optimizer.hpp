@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "chunk.hpp"
+
+// -O0 keeps the chunk exactly as emitted. -O1 rewrites instruction pairs: comparison + `op_not` becomes the negated
+// comparison, double negations whose operand type is known are dropped, and sequences with a superinstruction are
+// fused. -O2 additionally folds operators whose operands are all constants into a single load.
+inline constexpr int MAX_OPT_LEVEL = 2;
+inline constexpr int DEFAULT_OPT_LEVEL = 2;
+
+// Fusing a sequence into a superinstruction keeps every part's work, so it saves dispatches but removes no
+// instructions: instructionsAfter counts the rewritten code before fusion and dispatchesAfter the encoded chunk.
+struct OptimizerStats {
+    std::size_t chunks{0};
+    std::size_t instructionsBefore{0};
+    std::size_t instructionsAfter{0};
+    std::size_t dispatchesAfter{0};
+
+    [[nodiscard]] constexpr std::size_t eliminated() const noexcept { return instructionsBefore - instructionsAfter; }
+    [[nodiscard]] constexpr std::size_t fused() const noexcept { return instructionsAfter - dispatchesAfter; }
+};
+
+// How often each base opcode pair and triple occurs in the optimised (but not yet fused) code, indexed
+// a * BASE_OPCODE_COUNT + b and (a * BASE_OPCODE_COUNT + b) * BASE_OPCODE_COUNT + c. Chunks are straight-line, so every
+// instruction runs exactly once and these static counts equal the dynamic ones; once control flow exists the
+// counting has to move into the VM.
+struct SequenceCounts {
+    std::vector<uint64_t> pairs;
+    std::vector<uint64_t> triples;
+};
+
+// Settings and running totals for every chunk compiled in one Context.
+struct OptimizerState {
+    int level{DEFAULT_OPT_LEVEL};
+    bool countSequences{false};
+    OptimizerStats stats{};
+    SequenceCounts sequences{};
+};
+
+// Rewrites a finished chunk in place and adds its instruction and dispatch counts to `state.stats`. Unused constants
+// are dropped from the pool afterwards, so folded-away literals do not keep wide operands alive. `vm` owns the heap
+// the chunk's constants live in.
+void optimizeChunk(VM& vm, OptimizerState& state, Chunk& chunk);
+
+void printOptimizerStats(const OptimizerState& state);
+
+// Writes the counts as tab-separated `count<TAB>opcode opcode [opcode]` lines, most frequent first, for
+// scripts/gen_superinstructions.py. Returns false if the file cannot be written.
+[[nodiscard]] bool writeSequenceCounts(const OptimizerState& state, const std::string& path);
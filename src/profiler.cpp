@@ -0,0 +1,116 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <numeric>
+#include <print>
+#include <utility>
+
+namespace {
+    // The report lists this many of the hottest lines; the JSON has all of them.
+    constexpr std::size_t PROFILE_REPORT_LINES = 20;
+
+    struct OpcodeRow {
+        OpCode op;
+        uint64_t count;
+        uint64_t ticks;
+    };
+
+    std::vector<OpcodeRow> opcodeRows(const Profiler& profiler) {
+        std::vector<OpcodeRow> rows;
+        for (std::size_t i{0}; i < OPCODE_COUNT; ++i) {
+            if (profiler.counts[i] != 0) {
+                rows.push_back({static_cast<OpCode>(i), profiler.counts[i], profiler.ticks[i]});
+            }
+        }
+        std::ranges::stable_sort(rows, std::greater<>(), &OpcodeRow::ticks);
+        return rows;
+    }
+
+    std::vector<std::pair<int, uint64_t>> lineRows(const Profiler& profiler) {
+        std::vector<std::pair<int, uint64_t>> rows(profiler.lineHits.begin(), profiler.lineHits.end());
+        std::ranges::stable_sort(rows, std::greater<>(), &std::pair<int, uint64_t>::second);
+        return rows;
+    }
+} // namespace
+
+void Profiler::beginRun(const Chunk& chunk) {
+    offsetHits.assign(chunk.count(), 0);
+    running = false;
+}
+
+void Profiler::endRun(const Chunk& chunk) {
+    if (running) {
+        ticks[static_cast<std::size_t>(current)] += readProfileTicks() - started;
+        running = false;
+    }
+
+    // Each run covers [run.offset, next run's offset), so one pass over the runs attributes every offset.
+    for (std::size_t i{0}; i < chunk.lines.size(); ++i) {
+        auto begin = static_cast<std::size_t>(chunk.lines[i].offset);
+        std::size_t end = i + 1 < chunk.lines.size() ? static_cast<std::size_t>(chunk.lines[i + 1].offset)
+                                                     : offsetHits.size();
+        end = std::min(end, offsetHits.size());
+        if (begin >= end) {
+            continue;
+        }
+        uint64_t hits = std::accumulate(offsetHits.begin() + static_cast<std::ptrdiff_t>(begin),
+                                        offsetHits.begin() + static_cast<std::ptrdiff_t>(end), uint64_t{0});
+        if (hits != 0) {
+            lineHits[chunk.lines[i].line] += hits;
+        }
+    }
+
+    offsetHits.clear();
+}
+
+void printProfile(std::FILE* out, const Profiler& profiler) {
+    auto rows = opcodeRows(profiler);
+    uint64_t totalTicks = std::accumulate(profiler.ticks.begin(), profiler.ticks.end(), uint64_t{0});
+    uint64_t totalCount = std::accumulate(profiler.counts.begin(), profiler.counts.end(), uint64_t{0});
+
+    std::println(out, "== profile ({}) ==", PROFILE_TICK_UNIT);
+    // Superinstruction names can be long; size the first column to the longest one.
+    std::size_t width = std::ranges::max(OPCODE_NAMES, {}, &std::string_view::size).size();
+    std::println(out, "{:<{}} {:>12} {:>14} {:>7} {:>10}", "opcode", width, "count", PROFILE_TICK_UNIT, "%", "per op");
+    for (const auto& row: rows) {
+        double share = totalTicks == 0 ? 0.0 : 100.0 * static_cast<double>(row.ticks) / static_cast<double>(totalTicks);
+        std::println(out, "{:<{}} {:>12} {:>14} {:>6.1f}% {:>10.1f}", OPCODE_NAMES[static_cast<std::size_t>(row.op)],
+                     width, row.count, row.ticks, share,
+                     static_cast<double>(row.ticks) / static_cast<double>(row.count));
+    }
+    std::println(out, "{:<{}} {:>12} {:>14}", "total", width, totalCount, totalTicks);
+
+    auto lines = lineRows(profiler);
+    std::println(out, "hottest lines ({} of {}):", std::min(lines.size(), PROFILE_REPORT_LINES), lines.size());
+    for (std::size_t i{0}; i < lines.size() && i < PROFILE_REPORT_LINES; ++i) {
+        std::println(out, "  line {:>6}: {}", lines[i].first, lines[i].second);
+    }
+}
+
+bool writeProfileJson(const Profiler& profiler, const std::string& path) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        std::println(stderr, "Failed to open file for writing: {}", path);
+        return false;
+    }
+
+    // Opcode names are identifiers, so nothing needs escaping.
+    file << std::format("{{\n  \"unit\": \"{}\",\n  \"opcodes\": [", PROFILE_TICK_UNIT);
+    auto rows = opcodeRows(profiler);
+    for (std::size_t i{0}; i < rows.size(); ++i) {
+        file << (i == 0 ? "\n" : ",\n");
+        file << std::format("    {{\"name\": \"{}\", \"count\": {}, \"ticks\": {}}}",
+                            OPCODE_NAMES[static_cast<std::size_t>(rows[i].op)], rows[i].count, rows[i].ticks);
+    }
+    file << "\n  ],\n  \"lines\": [";
+    auto lines = lineRows(profiler);
+    for (std::size_t i{0}; i < lines.size(); ++i) {
+        file << (i == 0 ? "\n" : ",\n");
+        file << std::format("    {{\"line\": {}, \"hits\": {}}}", lines[i].first, lines[i].second);
+    }
+    file << "\n  ]\n}\n";
+
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "chunk.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Profiling time is read from the time-stamp counter where there is one and from the monotonic clock otherwise; the
+// report names the unit it used.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+inline constexpr std::string_view PROFILE_TICK_UNIT = "cycles";
+[[nodiscard]] inline uint64_t readProfileTicks() noexcept { return __rdtsc(); }
+#else
+inline constexpr std::string_view PROFILE_TICK_UNIT = "ns";
+[[nodiscard]] inline uint64_t readProfileTicks() noexcept {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now().time_since_epoch())
+                                         .count());
+}
+#endif
+
+// What --profile collects across every chunk a VM runs. Only run<Trace, true> calls enter(), so the normal dispatch
+// loop carries none of this.
+struct Profiler {
+    // Executions and ticks per opcode, indexed by OpCode. A superinstruction or quickened instruction counts as
+    // itself, not as the generic opcodes it stands for.
+    std::array<uint64_t, OPCODE_COUNT> counts{};
+    std::array<uint64_t, OPCODE_COUNT> ticks{};
+    // Instructions executed per source line.
+    std::map<int, uint64_t> lineHits;
+
+    // Executions per code offset of the chunk being run; folded into lineHits by endRun().
+    std::vector<uint64_t> offsetHits;
+    OpCode current{OpCode::ret};
+    uint64_t started{0};
+    bool running{false};
+
+    void beginRun(const Chunk& chunk);
+    // Called before each dispatch: charges the ticks since the previous call to the instruction that was running and
+    // starts timing `op`. The cost of the counter read itself is charged along with it.
+    void enter(OpCode op, std::size_t offset) noexcept {
+        uint64_t now = readProfileTicks();
+        if (running) {
+            ticks[static_cast<std::size_t>(current)] += now - started;
+        }
+        current = op;
+        started = now;
+        running = true;
+        ++counts[static_cast<std::size_t>(op)];
+        ++offsetHits[offset];
+    }
+    // Charges the last instruction and resolves this run's offsets to lines through Chunk::lines.
+    void endRun(const Chunk& chunk);
+};
+
+// Opcodes by total ticks, then the hottest source lines.
+void printProfile(std::FILE* out, const Profiler& profiler);
+bool writeProfileJson(const Profiler& profiler, const std::string& path);
@@ -0,0 +1,214 @@
+#include "scan_kernels.hpp"
+#include <bit>
+#include <cstddef>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+static const char* skipIdentifierScalar(const char* p, const char* end) {
+    while (p < end && isAlnum(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char* skipWhitespaceScalar(const char* p, const char* end, int* lines) {
+    while (p < end && hasClass(*p, char_space)) {
+        *lines += *p == '\n';
+        p++;
+    }
+    return p;
+}
+
+static const char* findNewlineScalar(const char* p, const char* end) {
+    while (p < end && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+static const char* findQuoteScalar(const char* p, const char* end, int* lines) {
+    while (p < end && *p != '"') {
+        *lines += *p == '\n';
+        p++;
+    }
+    return p;
+}
+
+#ifdef SCAN_X86
+
+// Each kernel computes, per block, a bitmask of the bytes that stop the scan. The first set bit is the answer; if
+// there is none the whole block is skipped. Newlines before the stop byte are counted with popcount.
+
+static inline int countNewlines(uint32_t newlineMask, uint32_t stopMask) {
+    uint32_t before = stopMask == 0 ? newlineMask : newlineMask & ((1u << std::countr_zero(stopMask)) - 1);
+    return std::popcount(before);
+}
+
+// Signed-compare trick for an unsigned range test: (c - lo) as unsigned < count.
+static inline __m128i inRange128(__m128i bytes, char lo, char count) {
+    __m128i shifted = _mm_sub_epi8(bytes, _mm_set1_epi8(static_cast<char>(lo + 128)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(count - 128)));
+}
+
+static inline __m128i identMask128(__m128i bytes) {
+    __m128i lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+    __m128i letters = inRange128(lower, 'a', 26);
+    __m128i digits = inRange128(bytes, '0', 10);
+    __m128i underscore = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letters, digits), underscore);
+}
+
+static inline __m128i spaceMask128(__m128i bytes) {
+    __m128i space = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    __m128i tab = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t'));
+    __m128i cr = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'));
+    __m128i lf = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'));
+    return _mm_or_si128(_mm_or_si128(space, tab), _mm_or_si128(cr, lf));
+}
+
+static inline uint32_t movemask128(__m128i mask) { return static_cast<uint32_t>(_mm_movemask_epi8(mask)); }
+
+static const char* skipIdentifierSse2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t stop = ~movemask128(identMask128(bytes)) & 0xffff;
+        if (stop != 0) {
+            return p + std::countr_zero(stop);
+        }
+    }
+    return skipIdentifierScalar(p, end);
+}
+
+static const char* skipWhitespaceSse2(const char* p, const char* end, int* lines) {
+    for (; end - p >= 16; p += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t stop = ~movemask128(spaceMask128(bytes)) & 0xffff;
+        *lines += countNewlines(movemask128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))), stop);
+        if (stop != 0) {
+            return p + std::countr_zero(stop);
+        }
+    }
+    return skipWhitespaceScalar(p, end, lines);
+}
+
+static const char* findNewlineSse2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t stop = movemask128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+        if (stop != 0) {
+            return p + std::countr_zero(stop);
+        }
+    }
+    return findNewlineScalar(p, end);
+}
+
+static const char* findQuoteSse2(const char* p, const char* end, int* lines) {
+    for (; end - p >= 16; p += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t stop = movemask128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('"')));
+        *lines += countNewlines(movemask128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))), stop);
+        if (stop != 0) {
+            return p + std::countr_zero(stop);
+        }
+    }
+    return findQuoteScalar(p, end, lines);
+}
+
+#define SCAN_AVX2 __attribute__((target("avx2")))
+
+SCAN_AVX2 static inline __m256i inRange256(__m256i bytes, char lo, char count) {
+    __m256i shifted = _mm256_sub_epi8(bytes, _mm256_set1_epi8(static_cast<char>(lo + 128)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(count - 128)), shifted);
+}
+
+SCAN_AVX2 static inline uint32_t movemask256(__m256i mask) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(mask));
+}
+
+SCAN_AVX2 static const char* skipIdentifierAvx2(const char* p, const char* end) {
+    for (; end - p >= 32; p += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i lower = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+        __m256i letters = inRange256(lower, 'a', 26);
+        __m256i digits = inRange256(bytes, '0', 10);
+        __m256i underscore = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_'));
+        uint32_t stop = ~movemask256(_mm256_or_si256(_mm256_or_si256(letters, digits), underscore));
+        if (stop != 0) {
+            return p + std::countr_zero(stop);
+        }
+    }
+    return skipIdentifierSse2(p, end);
+}
+
+SCAN_AVX2 static const char* skipWhitespaceAvx2(const char* p, const char* end, int* lines) {
+    for (; end - p >= 32; p += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i lf = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'));
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t')));
+        space = _mm256_or_si256(space, _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r')), lf));
+        uint32_t stop = ~movemask256(space);
+        *lines += countNewlines(movemask256(lf), stop);
+        if (stop != 0) {
+            return p + std::countr_zero(stop);
+        }
+    }
+    return skipWhitespaceSse2(p, end, lines);
+}
+
+SCAN_AVX2 static const char* findNewlineAvx2(const char* p, const char* end) {
+    for (; end - p >= 32; p += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t stop = movemask256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+        if (stop != 0) {
+            return p + std::countr_zero(stop);
+        }
+    }
+    return findNewlineSse2(p, end);
+}
+
+SCAN_AVX2 static const char* findQuoteAvx2(const char* p, const char* end, int* lines) {
+    for (; end - p >= 32; p += 32) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t stop = movemask256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"')));
+        *lines += countNewlines(movemask256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'))), stop);
+        if (stop != 0) {
+            return p + std::countr_zero(stop);
+        }
+    }
+    return findQuoteSse2(p, end, lines);
+}
+
+#undef SCAN_AVX2
+
+static constexpr ScanKernels SSE2_KERNELS{"sse2", skipIdentifierSse2, skipWhitespaceSse2, findNewlineSse2,
+                                          findQuoteSse2};
+static constexpr ScanKernels AVX2_KERNELS{"avx2", skipIdentifierAvx2, skipWhitespaceAvx2, findNewlineAvx2,
+                                          findQuoteAvx2};
+
+#endif
+
+static constexpr ScanKernels SCALAR_KERNELS{"scalar", skipIdentifierScalar, skipWhitespaceScalar, findNewlineScalar,
+                                            findQuoteScalar};
+
+const ScanKernels& scalarScanKernels() { return SCALAR_KERNELS; }
+
+const ScanKernels& scanKernels() {
+    static const ScanKernels& selected = []() -> const ScanKernels& {
+#ifdef SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return AVX2_KERNELS;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return SSE2_KERNELS;
+        }
+#endif
+        return SCALAR_KERNELS;
+    }();
+
+    return selected;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Byte classes used by the scanner. Everything outside 7-bit ASCII is unclassified.
+enum CharClass : uint8_t {
+    char_alpha = 1 << 0,
+    char_digit = 1 << 1,
+    char_space = 1 << 2,
+    char_newline = 1 << 3,
+};
+
+inline constexpr std::array<uint8_t, 256> CHAR_CLASSES = [] {
+    std::array<uint8_t, 256> classes{};
+    for (int c = 'a'; c <= 'z'; c++) {
+        classes[static_cast<std::size_t>(c)] |= char_alpha;
+    }
+    for (int c = 'A'; c <= 'Z'; c++) {
+        classes[static_cast<std::size_t>(c)] |= char_alpha;
+    }
+    classes['_'] |= char_alpha;
+    for (int c = '0'; c <= '9'; c++) {
+        classes[static_cast<std::size_t>(c)] |= char_digit;
+    }
+    classes[' '] |= char_space;
+    classes['\t'] |= char_space;
+    classes['\r'] |= char_space;
+    classes['\n'] |= char_space | char_newline;
+    return classes;
+}();
+
+constexpr bool hasClass(char c, uint8_t mask) { return (CHAR_CLASSES[static_cast<uint8_t>(c)] & mask) != 0; }
+constexpr bool isAlpha(char c) { return hasClass(c, char_alpha); }
+constexpr bool isDigit(char c) { return hasClass(c, char_digit); }
+constexpr bool isAlnum(char c) { return hasClass(c, char_alpha | char_digit); }
+
+// Bulk skipping loops used by the scanner. Each takes the half-open range [p, end), never reads at or past `end`,
+// and returns the first byte that stops the scan (or `end`). Functions that can cross line breaks add the number of
+// '\n' bytes they skipped to `*lines`.
+struct ScanKernels {
+    const char* name;
+    // First byte that is not a letter, digit or '_'.
+    const char* (*skipIdentifier)(const char* p, const char* end);
+    // First byte that is not ' ', '\t', '\r' or '\n'.
+    const char* (*skipWhitespace)(const char* p, const char* end, int* lines);
+    // First '\n' (the end of a line comment).
+    const char* (*findNewline)(const char* p, const char* end);
+    // First '"' (the end of a string literal body).
+    const char* (*findQuote)(const char* p, const char* end, int* lines);
+};
+
+// The widest implementation the running CPU supports: AVX2, then SSE2, then portable scalar code. Chosen once, on
+// first use.
+const ScanKernels& scanKernels();
+const ScanKernels& scalarScanKernels();
@@ -1,17 +1,21 @@
 #include "scanner.hpp"
-#include <cctype>
+#include <array>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string_view>
+#include "scan_kernels.hpp"
 
-using namespace Scanners;
-
-void initScanner(std::string_view source) {
+void initScanner(Scanner& scanner, std::string_view source) {
   scanner = Scanner{source};
 }
 
-bool isAtEnd() { return *scanner.current == '\0'; }
+// The source is not required to be NUL-terminated (a memory-mapped file is not), so every read is bounded by
+// scanner.end instead.
+bool isAtEnd(Scanner& scanner) { return scanner.current >= scanner.end; }
 
-Token makeToken(TokenType type) {
+Token makeToken(Scanner& scanner, TokenType type) {
     Token token{};
     token.type = type;
     token.start = scanner.start;
@@ -21,7 +25,7 @@ Token makeToken(TokenType type) {
     return token;
 }
 
-Token errorToken(std::string_view msg) {
+Token errorToken(Scanner& scanner, std::string_view msg) {
     Token token{};
     token.type = TokenType::err;
     token.start = msg.data();
@@ -31,13 +35,13 @@ Token errorToken(std::string_view msg) {
     return token;
 }
 
-char advance() {
+char advance(Scanner& scanner) {
     scanner.current++;
     return scanner.current[-1];
 }
 
-bool match(char token) {
-    if (isAtEnd()) {
+bool match(Scanner& scanner, char token) {
+    if (isAtEnd(scanner)) {
         return false;
     }
 
@@ -49,193 +53,235 @@ bool match(char token) {
     return true;
 }
 
-char peek() { return *scanner.current; }
-char peekNext() {
-    if (isAtEnd()) {
+char peek(Scanner& scanner) { return isAtEnd(scanner) ? '\0' : *scanner.current; }
+char peekNext(Scanner& scanner) {
+    if (scanner.end - scanner.current < 2) {
         return '\0';
     }
 
     return scanner.current[1];
 }
 
-void skipWhitespace() {
+void skipWhitespace(Scanner& scanner) {
+    const ScanKernels& kernels = scanKernels();
     while (true) {
-        char c = peek();
-        switch (c) {
-            case ' ':
-            case '\r':
-            case '\t':
-                advance();
-                break;
-            case '\n':
-                scanner.line++;
-                advance();
-                break;
-            case '/':
-                if (peekNext() == '/') {
-                    while (peek() != '\n' && !isAtEnd())
-                        advance();
-                } else {
-                    return;
-                }
-                break;
-            default:
-                return;
+        scanner.current = kernels.skipWhitespace(scanner.current, scanner.end, &scanner.line);
+        if (scanner.end - scanner.current >= 2 && scanner.current[0] == '/' && scanner.current[1] == '/') {
+            scanner.current = kernels.findNewline(scanner.current + 2, scanner.end);
+            continue;
         }
+
+        return;
     }
 }
 
-Token string() {
-    while (peek() != '"' && !isAtEnd()) {
-        if (peek() == '\n') {
-            scanner.line++;
-        }
-
-        advance();
-    }
+Token string(Scanner& scanner) {
+    scanner.current = scanKernels().findQuote(scanner.current, scanner.end, &scanner.line);
 
-    if (isAtEnd()) {
-        return errorToken("Unterminated string");
+    if (isAtEnd(scanner)) {
+        return errorToken(scanner, "Unterminated string");
     }
 
-    advance();
-    return makeToken(TokenType::string);
+    advance(scanner);
+    return makeToken(scanner, TokenType::string);
 }
 
-Token number() {
-    while (std::isdigit(peek())) {
-        advance();
+Token number(Scanner& scanner) {
+    while (isDigit(peek(scanner))) {
+        advance(scanner);
     }
 
-    if (peek() == '.' && std::isdigit(peekNext())) {
-        advance();
-        while (std::isdigit(peek())) {
-            advance();
+    if (peek(scanner) == '.' && isDigit(peekNext(scanner))) {
+        advance(scanner);
+        while (isDigit(peek(scanner))) {
+            advance(scanner);
         }
     }
 
-    return makeToken(TokenType::number);
+    return makeToken(scanner, TokenType::number);
 }
 
-TokenType checkKeyword(size_t start, size_t remLen, std::string_view remWord, TokenType type) {
-    std::string_view keyword{scanner.start + start, remLen};
+// Keyword recognition is a perfect hash on (first byte, last byte, length), confirmed by comparing the whole lexeme,
+// packed into one 64-bit word, against the keyword. The hash multipliers are searched for at compile time, so adding
+// a keyword only needs a new line here.
+struct Keyword {
+    std::string_view text;
+    TokenType type;
+};
+
+static constexpr auto KEYWORDS = std::to_array<Keyword>({
+    {"and", TokenType::tok_and},
+    {"class", TokenType::tok_class},
+    {"else", TokenType::tok_else},
+    {"false", TokenType::tok_false},
+    {"for", TokenType::tok_for},
+    {"fun", TokenType::fun},
+    {"if", TokenType::tok_if},
+    {"nil", TokenType::nil},
+    {"or", TokenType::tok_or},
+    {"print", TokenType::tok_print},
+    {"return", TokenType::tok_ret},
+    {"super", TokenType::super},
+    {"this", TokenType::tok_this},
+    {"true", TokenType::tok_true},
+    {"var", TokenType::var},
+    {"while", TokenType::tok_while},
+});
+
+static constexpr std::size_t KEYWORD_MAX_LENGTH = sizeof(uint64_t);
+static constexpr std::size_t KEYWORD_SLOTS = 64;
+
+struct KeywordHash {
+    uint32_t first;
+    uint32_t last;
+};
+
+static constexpr std::size_t keywordSlot(KeywordHash hash, std::string_view text) {
+    return (static_cast<uint8_t>(text.front()) * hash.first + static_cast<uint8_t>(text.back()) * hash.last +
+            text.size()) &
+           (KEYWORD_SLOTS - 1);
+}
 
-    if (static_cast<size_t>(scanner.current - scanner.start) == start + remLen && keyword == remWord) {
-        return type;
+static constexpr KeywordHash KEYWORD_HASH = [] {
+    for (uint32_t first = 1; first < KEYWORD_SLOTS; first++) {
+        for (uint32_t last = 1; last < KEYWORD_SLOTS; last++) {
+            std::array<bool, KEYWORD_SLOTS> used{};
+            bool collision = false;
+            for (const auto& keyword: KEYWORDS) {
+                std::size_t slot = keywordSlot({first, last}, keyword.text);
+                collision = collision || used[slot];
+                used[slot] = true;
+            }
+            if (!collision) {
+                return KeywordHash{first, last};
+            }
+        }
     }
+    return KeywordHash{0, 0};
+}();
 
-    return TokenType::identifier;
+static_assert(KEYWORD_HASH.first != 0, "No collision-free keyword hash found; increase KEYWORD_SLOTS.");
+
+// Little-endian packing of up to eight bytes, zero padded, so it matches a memcpy of the lexeme into a uint64_t.
+static constexpr uint64_t packWord(std::string_view text) {
+    uint64_t word = 0;
+    for (std::size_t i = 0; i < text.size(); i++) {
+        word |= static_cast<uint64_t>(static_cast<uint8_t>(text[i])) << (8 * i);
+    }
+    return word;
 }
 
-TokenType identType() {
-    switch (scanner.start[0]) {
-        case 'a':
-            return checkKeyword(1, 2, "nd", TokenType::tok_and);
-        case 'c':
-            return checkKeyword(1, 4, "lass", TokenType::tok_class);
-        case 'e':
-            return checkKeyword(1, 3, "lse", TokenType::tok_else);
-        case 'f':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'a':
-                        return checkKeyword(2, 3, "lse", TokenType::tok_false);
-                    case 'o':
-                        return checkKeyword(2, 1, "r", TokenType::tok_for);
-                    case 'u':
-                        return checkKeyword(2, 1, "n", TokenType::fun);
-                }
-            }
-            break;
-        case 'i':
-            return checkKeyword(1, 1, "f", TokenType::tok_if);
-        case 'n':
-            return checkKeyword(1, 2, "il", TokenType::nil);
-        case 'o':
-            return checkKeyword(1, 1, "r", TokenType::tok_or);
-        case 'p':
-            return checkKeyword(1, 4, "rint", TokenType::tok_print);
-        case 'r':
-            return checkKeyword(1, 5, "eturn", TokenType::tok_ret);
-        case 's':
-            return checkKeyword(1, 4, "uper", TokenType::super);
-        case 't':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'h':
-                        return checkKeyword(2, 2, "is", TokenType::tok_this);
-                    case 'r':
-                        return checkKeyword(2, 2, "ue", TokenType::tok_true);
-                }
-            }
-            break;
-        case 'v':
-            return checkKeyword(1, 2, "ar", TokenType::var);
-        case 'w':
-            return checkKeyword(1, 4, "hile", TokenType::tok_while);
+struct KeywordSlot {
+    uint64_t word{0};
+    std::size_t length{0};
+    TokenType type{TokenType::identifier};
+};
+
+static constexpr std::array<KeywordSlot, KEYWORD_SLOTS> KEYWORD_TABLE = [] {
+    std::array<KeywordSlot, KEYWORD_SLOTS> table{};
+    for (const auto& keyword: KEYWORDS) {
+        table[keywordSlot(KEYWORD_HASH, keyword.text)] = {packWord(keyword.text), keyword.text.size(), keyword.type};
+    }
+    return table;
+}();
+
+static constexpr TokenType keywordType(std::string_view text) {
+    if (text.empty() || text.size() > KEYWORD_MAX_LENGTH) {
+        return TokenType::identifier;
+    }
+
+    const KeywordSlot& slot = KEYWORD_TABLE[keywordSlot(KEYWORD_HASH, text)];
+    if (slot.length != text.size()) {
+        return TokenType::identifier;
     }
 
-    return TokenType::identifier;
+    uint64_t word = 0;
+    if consteval {
+        word = packWord(text);
+    } else {
+        // On a big-endian host the lexeme lands in the high bytes, first byte highest; swapping puts the first byte
+        // lowest, which is exactly packWord's layout.
+        std::memcpy(&word, text.data(), text.size());
+        if constexpr (std::endian::native == std::endian::big) {
+            word = std::byteswap(word);
+        }
+    }
+
+    return word == slot.word ? slot.type : TokenType::identifier;
 }
 
-Token identifier() {
-    while (std::isalpha(peek()) || std::isdigit(peek())) {
-        advance();
+static_assert([] {
+    for (const auto& keyword: KEYWORDS) {
+        if (keyword.text.size() > KEYWORD_MAX_LENGTH || keywordType(keyword.text) != keyword.type) {
+            return false;
+        }
     }
+    return true;
+}(), "Every keyword must hash to its own slot.");
+static_assert(keywordType("an") == TokenType::identifier && keywordType("andy") == TokenType::identifier &&
+                  keywordType("fals") == TokenType::identifier && keywordType("whilst") == TokenType::identifier &&
+                  keywordType("Class") == TokenType::identifier && keywordType("returns") == TokenType::identifier,
+              "Near misses must stay identifiers.");
+
+TokenType identType(Scanner& scanner) {
+    return keywordType({scanner.start, static_cast<std::size_t>(scanner.current - scanner.start)});
+}
 
-    return makeToken(identType());
+Token identifier(Scanner& scanner) {
+    scanner.current = scanKernels().skipIdentifier(scanner.current, scanner.end);
+    return makeToken(scanner, identType(scanner));
 }
 
-Token scanToken() {
-    skipWhitespace();
+Token scanToken(Scanner& scanner) {
+    skipWhitespace(scanner);
     scanner.start = scanner.current;
-    if (isAtEnd()) {
-        return makeToken(TokenType::eof);
+    if (isAtEnd(scanner)) {
+        return makeToken(scanner, TokenType::eof);
     }
 
-    char c = advance();
-    if (std::isalpha(c) || c == '-') {
-        return identifier();
+    char c = advance(scanner);
+    if (isAlpha(c)) {
+        return identifier(scanner);
     }
 
-    if (std::isdigit(c)) {
-        return number();
+    if (isDigit(c)) {
+        return number(scanner);
     }
 
     switch (c) {
         case '(':
-            return makeToken(TokenType::left_paren);
+            return makeToken(scanner, TokenType::left_paren);
         case ')':
-            return makeToken(TokenType::right_paren);
+            return makeToken(scanner, TokenType::right_paren);
         case '{':
-            return makeToken(TokenType::left_brace);
+            return makeToken(scanner, TokenType::left_brace);
         case '}':
-            return makeToken(TokenType::right_brace);
+            return makeToken(scanner, TokenType::right_brace);
         case ';':
-            return makeToken(TokenType::semicolon);
+            return makeToken(scanner, TokenType::semicolon);
         case ',':
-            return makeToken(TokenType::comma);
+            return makeToken(scanner, TokenType::comma);
         case '.':
-            return makeToken(TokenType::dot);
+            return makeToken(scanner, TokenType::dot);
         case '-':
-            return makeToken(TokenType::minus);
+            return makeToken(scanner, TokenType::minus);
         case '+':
-            return makeToken(TokenType::plus);
+            return makeToken(scanner, TokenType::plus);
         case '/':
-            return makeToken(TokenType::slash);
+            return makeToken(scanner, TokenType::slash);
         case '*':
-            return makeToken(TokenType::star);
+            return makeToken(scanner, TokenType::star);
         case '!':
-            return makeToken(match('=') ? TokenType::bang_equal : TokenType::bang);
+            return makeToken(scanner, match(scanner, '=') ? TokenType::bang_equal : TokenType::bang);
         case '=':
-            return makeToken(match('=') ? TokenType::equal_equal : TokenType::equal);
+            return makeToken(scanner, match(scanner, '=') ? TokenType::equal_equal : TokenType::equal);
         case '<':
-            return makeToken(match('=') ? TokenType::less_equal : TokenType::less);
+            return makeToken(scanner, match(scanner, '=') ? TokenType::less_equal : TokenType::less);
         case '>':
-            return makeToken(match('=') ? TokenType::greater_equal : TokenType::greater);
+            return makeToken(scanner, match(scanner, '=') ? TokenType::greater_equal : TokenType::greater);
         case '"':
-            return string();
+            return string(scanner);
     }
 
-    return errorToken("Unexpected character");
+    return errorToken(scanner, "Unexpected character");
 }
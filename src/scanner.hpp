@@ -49,9 +49,11 @@ enum class TokenType : uint8_t {
 struct Scanner {
     const char* start{nullptr};
     const char* current{nullptr};
+    // One past the last source byte. Nothing in the scanner reads at or beyond it.
+    const char* end{nullptr};
     int line{1};
 
-    constexpr explicit Scanner(std::string_view s) : start{s.data()}, current{s.data()} {}
+    constexpr explicit Scanner(std::string_view s) : start{s.data()}, current{s.data()}, end{s.data() + s.size()} {}
 };
 
 struct Token {
@@ -61,9 +63,5 @@ struct Token {
     int line{};
 };
 
-namespace Scanners {
-    inline constinit Scanner scanner{""};
-} // namespace Scanners
-
-void initScanner(std::string_view source);
-[[nodiscard]] Token scanToken();
+void initScanner(Scanner& scanner, std::string_view source);
+[[nodiscard]] Token scanToken(Scanner& scanner);
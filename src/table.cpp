@@ -0,0 +1,137 @@
+#include "table.hpp"
+#include <algorithm>
+#include <utility>
+#include "inline_decl.hpp"
+
+const Entry* Table::findEntry(const ObjString* key) const {
+    std::size_t mask = m_entries.size() - 1;
+    std::size_t index = key->getHash() & mask;
+    const Entry* tombstone = nullptr;
+
+    while (true) {
+        const Entry* entry = &m_entries[index];
+        if (entry->key == nullptr) {
+            if (isNil(entry->value)) {
+                return tombstone != nullptr ? tombstone : entry;
+            }
+            if (tombstone == nullptr) {
+                tombstone = entry;
+            }
+        } else if (entry->key == key) {
+            return entry;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+Entry* Table::findEntry(const ObjString* key) {
+    return const_cast<Entry*>(static_cast<const Table*>(this)->findEntry(key));
+}
+
+void Table::adjustCapacity(std::size_t capacity) {
+    std::vector<Entry> entries(capacity);
+    std::swap(entries, m_entries);
+
+    m_count = 0;
+    for (const auto& entry: entries) {
+        if (entry.key == nullptr) {
+            continue;
+        }
+
+        Entry* dest = findEntry(entry.key);
+        dest->key = entry.key;
+        dest->value = entry.value;
+        m_count++;
+    }
+}
+
+bool Table::get(const ObjString* key, Value* value) const {
+    if (m_count == 0) {
+        return false;
+    }
+
+    const Entry* entry = findEntry(key);
+    if (entry->key == nullptr) {
+        return false;
+    }
+
+    *value = entry->value;
+    return true;
+}
+
+bool Table::set(ObjString* key, Value value) {
+    if (static_cast<double>(m_count + 1) > static_cast<double>(capacity()) * MAX_LOAD) {
+        adjustCapacity(capacity() < 8 ? 8 : capacity() * 2);
+    }
+
+    Entry* entry = findEntry(key);
+    bool isNewKey = entry->key == nullptr;
+    if (isNewKey && isNil(entry->value)) {
+        m_count++;
+    }
+
+    entry->key = key;
+    entry->value = value;
+    return isNewKey;
+}
+
+bool Table::remove(const ObjString* key) {
+    if (m_count == 0) {
+        return false;
+    }
+
+    Entry* entry = findEntry(key);
+    if (entry->key == nullptr) {
+        return false;
+    }
+
+    entry->key = nullptr;
+    entry->value = boolValue(true);
+    return true;
+}
+
+ObjString* Table::findString(std::string_view prefix, std::string_view suffix, uint32_t hash) const {
+    if (m_count == 0) {
+        return nullptr;
+    }
+
+    std::size_t length = prefix.size() + suffix.size();
+    std::size_t mask = m_entries.size() - 1;
+    std::size_t index = hash & mask;
+
+    while (true) {
+        const Entry& entry = m_entries[index];
+        if (entry.key == nullptr) {
+            if (isNil(entry.value)) {
+                return nullptr;
+            }
+        } else if (entry.key->getLength() == length && entry.key->getHash() == hash) {
+            std::string_view chars = entry.key->getChars();
+            if (chars.substr(0, prefix.size()) == prefix && chars.substr(prefix.size()) == suffix) {
+                return entry.key;
+            }
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+bool Table::removeWhite(std::size_t& cursor, std::size_t budget) {
+    std::size_t end = std::min(m_entries.size(), cursor + std::min(budget, m_entries.size()));
+    for (; cursor < end; cursor++) {
+        Entry& entry = m_entries[cursor];
+        if (entry.key != nullptr && !entry.key->isMarked()) {
+            entry.key = nullptr;
+            entry.value = boolValue(true);
+        }
+    }
+
+    return cursor >= m_entries.size();
+}
+
+void Table::freeTable() {
+    m_entries.clear();
+    m_entries.shrink_to_fit();
+    m_count = 0;
+}
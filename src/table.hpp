@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "object.hpp"
+#include "value.hpp"
+
+struct Entry {
+    ObjString* key{nullptr};
+    Value value{};
+};
+
+// Open-addressing hash map keyed by interned strings, probed linearly using the hash cached in ObjString. Deleted
+// slots become tombstones (null key, true value) so probe sequences stay intact.
+class Table {
+public:
+    constexpr Table() = default;
+
+    [[nodiscard]] constexpr std::size_t count() const noexcept { return m_count; }
+    [[nodiscard]] constexpr std::size_t capacity() const noexcept { return m_entries.size(); }
+
+    bool get(const ObjString* key, Value* value) const;
+    bool set(ObjString* key, Value value);
+    bool remove(const ObjString* key);
+
+    // Looks up a string by content rather than identity. The key is `prefix` followed by `suffix`, which lets
+    // concatenation probe for an existing string before allocating one.
+    [[nodiscard]] ObjString* findString(std::string_view prefix, std::string_view suffix, uint32_t hash) const;
+    [[nodiscard]] ObjString* findString(std::string_view chars, uint32_t hash) const {
+        return findString(chars, {}, hash);
+    }
+
+    // Removes entries whose key was not marked by the collector, checking at most `budget` slots starting at `cursor`
+    // and advancing it. Returns true once the cursor has reached the end of the table.
+    bool removeWhite(std::size_t& cursor, std::size_t budget);
+    void freeTable();
+
+private:
+    static constexpr double MAX_LOAD = 0.75;
+
+    std::vector<Entry> m_entries{};
+    std::size_t m_count{0};
+
+    Entry* findEntry(const ObjString* key);
+    const Entry* findEntry(const ObjString* key) const;
+    void adjustCapacity(std::size_t capacity);
+};
@@ -0,0 +1,72 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace {
+    // One worker's share of the tasks. The owner takes from the front and thieves from the back, so the two only
+    // meet over the last task. All tasks are queued before any thread starts, so an empty queue stays empty.
+    class TaskQueue {
+    public:
+        void push(std::size_t task) { m_tasks.push_back(task); }
+
+        std::optional<std::size_t> pop() {
+            std::scoped_lock lock{m_mutex};
+            if (m_tasks.empty()) {
+                return std::nullopt;
+            }
+
+            std::size_t task = m_tasks.front();
+            m_tasks.pop_front();
+            return task;
+        }
+
+        std::optional<std::size_t> steal() {
+            std::scoped_lock lock{m_mutex};
+            if (m_tasks.empty()) {
+                return std::nullopt;
+            }
+
+            std::size_t task = m_tasks.back();
+            m_tasks.pop_back();
+            return task;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::deque<std::size_t> m_tasks;
+    };
+} // namespace
+
+void parallelFor(std::size_t taskCount, std::size_t workers,
+                 const std::function<void(std::size_t worker, std::size_t task)>& body) {
+    workers = std::clamp<std::size_t>(workers, 1, std::max<std::size_t>(taskCount, 1));
+    std::vector<TaskQueue> queues(workers);
+    for (std::size_t task{0}; task < taskCount; ++task) {
+        queues[task % workers].push(task);
+    }
+
+    auto work = [&](std::size_t self) {
+        while (true) {
+            auto task = queues[self].pop();
+            for (std::size_t i{1}; !task && i < workers; ++i) {
+                task = queues[(self + i) % workers].steal();
+            }
+            if (!task) {
+                return;
+            }
+            body(self, *task);
+        }
+    };
+
+    // The calling thread is worker 0 rather than sitting idle in join().
+    std::vector<std::jthread> threads;
+    threads.reserve(workers - 1);
+    for (std::size_t worker{1}; worker < workers; ++worker) {
+        threads.emplace_back(work, worker);
+    }
+    work(0);
+}
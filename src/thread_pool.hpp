@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Calls `body(worker, task)` once for every task in [0, taskCount) using `workers` threads, and returns when all of
+// them have finished. Tasks are dealt round-robin so each worker starts on the lowest indices it owns; a worker that
+// runs dry steals the highest index left in another worker's queue, so one slow task does not hold up the rest.
+// `worker` is in [0, workers) and identifies the thread, for per-thread state such as a Context.
+void parallelFor(std::size_t taskCount, std::size_t workers,
+                 const std::function<void(std::size_t worker, std::size_t task)>& body);
@@ -1,4 +1,5 @@
 #include "value.hpp"
+#include <cstdio>
 #include <print>
 #include "forward_decl.hpp"
 #include "inline_decl.hpp"
@@ -10,21 +11,17 @@ void ValueArray::freeValueArray() {
     values.shrink_to_fit();
 }
 
-void printValue(Value value) {
-    switch (value.type) {
-        case ValueType::val_bool:
-            std::print("{}", asBool(value) ? "true" : "false");
-            break;
-        case ValueType::val_nil:
-            std::print("nil");
-            break;
-        case ValueType::val_number:
-            std::print("{:g}", asNumber(value));
-            break;
-        case ValueType::val_obj:
-            printObj(value);
-            break;
-        default:
-            return;
+void printValue(std::FILE* out, Value value) {
+    if (isBool(value)) {
+        std::print(out, "{}", asBool(value) ? "true" : "false");
+    } else if (isNil(value)) {
+        std::print(out, "nil");
+    } else if (isNumber(value)) {
+        std::print(out, "{:g}", asNumber(value));
+    } else if (isShortString(value)) {
+        ShortStringBuffer buffer;
+        std::print(out, "{}", asShortString(value).unpack(buffer));
+    } else if (isObj(value)) {
+        printObj(out, value);
     }
 }
@@ -1,20 +1,104 @@
 #pragma once
 
+#include <array>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
 #include <variant>
 #include <vector>
 #include "forward_decl.hpp"
 
+// Strings of up to SHORT_STRING_MAX bytes are stored in the Value itself instead of as an ObjString. NaN boxing leaves
+// 48 bits of payload for them; the tagged layout has a whole 64-bit slot.
+#ifdef NAN_BOXING
+inline constexpr std::size_t SHORT_STRING_MAX = 6;
+#else
+inline constexpr std::size_t SHORT_STRING_MAX = 8;
+#endif
+
+using ShortStringBuffer = std::array<char, sizeof(uint64_t)>;
+
+// The characters of a short string packed little-endian and zero padded, so equal strings have equal bits and the
+// length is where the padding starts. A string containing '\0' therefore never fits.
+struct ShortString {
+    uint64_t packed{0};
+
+    [[nodiscard]] static constexpr bool fits(std::string_view chars) noexcept {
+        return chars.size() <= SHORT_STRING_MAX && chars.find('\0') == std::string_view::npos;
+    }
+
+    [[nodiscard]] static constexpr ShortString pack(std::string_view chars) noexcept {
+        ShortString string{};
+        for (std::size_t i{0}; i < chars.size(); ++i) {
+            string.packed |= uint64_t{static_cast<uint8_t>(chars[i])} << (8 * i);
+        }
+        return string;
+    }
+
+    [[nodiscard]] constexpr std::size_t length() const noexcept {
+        return static_cast<std::size_t>((std::bit_width(packed) + 7) / 8);
+    }
+
+    // Copies the characters into `buffer`, which must outlive the returned view.
+    [[nodiscard]] constexpr std::string_view unpack(ShortStringBuffer& buffer) const noexcept {
+        for (std::size_t i{0}; i < buffer.size(); ++i) {
+            buffer[i] = static_cast<char>((packed >> (8 * i)) & 0xff);
+        }
+        return {buffer.data(), length()};
+    }
+
+    friend constexpr bool operator==(ShortString a, ShortString b) noexcept = default;
+};
+
+#ifdef NAN_BOXING
+
+// Every non-number is stored inside the payload of a quiet NaN. Objects additionally set the sign bit and keep
+// their pointer in the low 48 bits; nil/false/true use the low two bits as a tag.
+inline constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+inline constexpr uint64_t QNAN = 0x7ffc000000000000;
+
+inline constexpr uint64_t TAG_NIL = 1;
+inline constexpr uint64_t TAG_FALSE = 2;
+inline constexpr uint64_t TAG_TRUE = 3;
+
+inline constexpr uint64_t NIL_VAL = QNAN | TAG_NIL;
+inline constexpr uint64_t FALSE_VAL = QNAN | TAG_FALSE;
+inline constexpr uint64_t TRUE_VAL = QNAN | TAG_TRUE;
+// Short strings keep their packed characters in the low 48 bits, below this tag bit.
+inline constexpr uint64_t SHORT_STRING_BIT = uint64_t{1} << 49;
+inline constexpr uint64_t SHORT_STRING_CHARS = (uint64_t{1} << 48) - 1;
+
+struct Value {
+    uint64_t bits{NIL_VAL};
+
+    constexpr Value(bool b) noexcept : bits(b ? TRUE_VAL : FALSE_VAL) {}
+    constexpr Value(double n) noexcept : bits(std::bit_cast<uint64_t>(n)) {}
+    constexpr Value() noexcept = default;
+    Value(Obj* o) noexcept : bits(SIGN_BIT | QNAN | static_cast<uint64_t>(reinterpret_cast<uintptr_t>(o))) {}
+    constexpr Value(ShortString s) noexcept : bits(QNAN | SHORT_STRING_BIT | s.packed) {}
+};
+
+static_assert(sizeof(Value) == sizeof(uint64_t), "NaN-boxed Value must fit in one machine word.");
+
+#else
+
 struct Value {
     ValueType type{};
-    std::variant<std::monostate, bool, double, Obj*> as{};
+    std::variant<std::monostate, bool, double, Obj*, ShortString> as{};
 
     constexpr Value(bool b) noexcept : type(ValueType::val_bool), as(b) {}
     constexpr Value(double n) noexcept : type(ValueType::val_number), as(n) {}
     constexpr Value() noexcept : type(ValueType::val_nil), as(std::monostate{}) {}
     constexpr Value(Obj* o) noexcept : type(ValueType::val_obj), as(o) {}
+    constexpr Value(ShortString s) noexcept : type(ValueType::val_short_string), as(s) {}
 };
 
+static_assert(sizeof(ShortString) == sizeof(Obj*), "A short string must fit in the slot an object pointer takes.");
+
+#endif
+
 struct ValueArray {
     std::vector<Value> values{};
 
@@ -29,4 +113,4 @@ struct ValueArray {
     void freeValueArray();
 };
 
-void printValue(Value value);
+void printValue(std::FILE* out, Value value);
@@ -1,5 +1,4 @@
 #include "vm.hpp"
-#include <cstring>
 #include <format>
 #include <functional>
 #include <print>
@@ -7,42 +6,41 @@
 #include <string>
 #include <string_view>
 #include "chunk.hpp"
-#include "common.hpp"
-#include "compiler.hpp"
 #include "debug.hpp"
 #include "inline_decl.hpp"
 
-using namespace VmInstance;
-
-static void runtimeError(const std::string& message) {
-    std::println(stderr, "Runtime Error: {}", message);
+static void runtimeError(VM& vm, const std::string& message) {
+    std::println(vm.err, "Runtime Error: {}", message);
 
     size_t instruction = vm.ip - vm.chunk->code.data() - 1;
-    int line = vm.chunk->lines[instruction];
+    int line = vm.chunk->getLine(instruction);
 
-    std::println(stderr, "[line {}] in script", line);
+    std::println(vm.err, "[line {}] in script", line);
     vm.resetStack();
 }
 
 template<typename... Args>
-static void formatRuntimeError(std::string_view fmt, Args&&... args) {
+static void formatRuntimeError(VM& vm, std::string_view fmt, Args&&... args) {
     std::string formattedMessage = std::vformat(fmt, std::make_format_args(std::forward<Args>(args)...));
-    runtimeError(formattedMessage);
+    runtimeError(vm, formattedMessage);
 }
 
-static Value peek(int distance) { return vm.top[-1 - distance]; }
-static void concatenate() {
-    auto b = asObjString(vm.pop());
-    auto a = asObjString(vm.pop());
+static void concatenate(VM& vm) {
+    // Both operands stay on the stack until the result exists so a collection triggered by the allocation sees them.
+    Value result = joinStrings(vm, vm.top[-2], vm.top[-1]);
 
-    auto len = a->getLength() + b->getLength();
-    auto chars = new char[len + 1];
-    std::memcpy(chars, a->getChars().data(), a->getLength());
-    std::memcpy(chars + a->getLength(), b->getChars().data(), b->getLength());
-    chars[len] = '\0';
+    vm.top -= 2;
+    vm.push(result);
+}
 
-    auto res = ObjString(std::string_view(chars, len));
-    vm.push(objValue(&res));
+// Replaces every rope in the top `count` stack slots with its flattened string. The slots are rewritten in place, so
+// each rope stays reachable while flattening allocates.
+static void flattenRopes(VM& vm, int count) {
+    for (Value* slot = vm.top - count; slot < vm.top; ++slot) {
+        if (isObjRope(*slot)) {
+            *slot = objValue(flattenRope(vm, asObjRope(*slot)));
+        }
+    }
 }
 
 constexpr void VM::push(Value value) {
@@ -55,114 +53,320 @@ constexpr Value VM::pop() {
     return *top;
 }
 
-template<typename Op>
-void binaryOp(Op op) {
-    if (!isNumber(peek(0)) || !isNumber(peek(1))) {
-        formatRuntimeError("Operands must be numbers.");
-    }
+// The fused comparisons keep the meaning of the `less`/`greater` + `op_not` pairs they replace, NaN included.
+static constexpr bool notLess(double a, double b) { return !(a < b); }
+static constexpr bool notGreater(double a, double b) { return !(a > b); }
 
-    auto b = asNumber(vm.pop());
-    auto a = asNumber(vm.pop());
-    vm.push(numberValue(op(a, b)));
-}
+// Handlers are written once against these macros. With COMPUTED_GOTO every handler ends in its own indirect jump
+// through a table built from OPCODE_LIST; otherwise the same bodies become the cases of a portable switch.
+#ifdef COMPUTED_GOTO
+#define OPCODE_LABEL(name, operands, ...) &&op_##name,
+#define CASE(name) op_##name
+#define DISPATCH()                                                                                                     \
+    do {                                                                                                               \
+        TRACE_INSTRUCTION();                                                                                           \
+        PROFILE_INSTRUCTION();                                                                                         \
+        goto* dispatchTable[READ_BYTE()];                                                                              \
+    } while (false)
+#else
+#define CASE(name) case OpCode::name
+#define DISPATCH() continue
+#endif
 
-static bool isFalsey(const Value& value) { return isNil(value) || (isBool(value) && !asBool(value)); }
+// ip, top and the constant pool live in locals for the whole loop so the compiler can keep them in registers instead
+// of reloading them through the global VM after every store. They are written back only where code outside the loop
+// can observe them: runtime errors, tracing, calls that touch the VM stack, and return.
+#define READ_BYTE() (*localIp++)
+#define READ_CONSTANT() (constants[READ_BYTE()])
+#define READ_CONSTANT_LONG() (localIp += 3, constants[localIp[-3] | (localIp[-2] << 8) | (localIp[-1] << 16)])
+#define PUSH(value) (*localTop++ = (value))
+#define POP() (*--localTop)
+#define PEEK(distance) (localTop[-1 - (distance)])
+#define SAVE_REGISTERS() (ip = localIp, top = localTop)
+#define LOAD_REGISTERS() (localIp = ip, localTop = top)
 
-InterpretResult VM::run() {
-    while (true) {
-#ifdef DEBUG_TRACE_EXECUTION
-        std::print("        ");
-        for (const auto& value: std::span(stack.data(), top)) {
-            std::print("[ ");
-            printValue(value);
-            std::print(" ]");
-        }
+// Quickening rewrites the instruction being executed, which starts at localIp[-1] in a base handler. Superinstruction
+// parts never quicken, since there localIp[-1] is not the part's opcode; each handler says which case it is through
+// `canQuicken`.
+#define SITE() (sites[localIp - 1 - code])
+#define QUICKEN(op)                                                                                                    \
+    do {                                                                                                               \
+        if constexpr (canQuicken) {                                                                                    \
+            if (sites == nullptr) {                                                                                    \
+                chunk->quickenSites.resize(chunk->code.size());                                                        \
+                sites = chunk->quickenSites.data();                                                                    \
+            }                                                                                                          \
+            if (SITE().misses < QUICKEN_MISS_LIMIT) {                                                                  \
+                localIp[-1] = static_cast<uint8_t>(OpCode::op);                                                        \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+#define DEQUICKEN()                                                                                                    \
+    do {                                                                                                               \
+        ++SITE().misses;                                                                                               \
+        localIp[-1] = static_cast<uint8_t>(genericOpcode(static_cast<OpCode>(localIp[-1])));                           \
+    } while (false)
+
+// Ropes are flattened before they are compared or printed, so valuesEq and printValue only ever see interned strings.
+#define FLATTEN_ROPES(count)                                                                                           \
+    do {                                                                                                               \
+        for (int slot{0}; slot < (count); ++slot) {                                                                    \
+            if (isObjRope(PEEK(slot))) [[unlikely]] {                                                                  \
+                SAVE_REGISTERS();                                                                                      \
+                flattenRopes(*this, count);                                                                            \
+                break;                                                                                                 \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+
+#define BINARY_OP(op)                                                                                                  \
+    do {                                                                                                               \
+        if (!isNumber(PEEK(0)) || !isNumber(PEEK(1))) {                                                                \
+            SAVE_REGISTERS();                                                                                          \
+            formatRuntimeError(*this, "Operands must be numbers.");                                                    \
+            return InterpretResult::runtime_error;                                                                     \
+        }                                                                                                              \
+        double b = asNumber(POP());                                                                                    \
+        double a = asNumber(POP());                                                                                    \
+        PUSH(Value(op(a, b)));                                                                                         \
+    } while (false)
+
+// Compiled out unless Trace; otherwise prints the stack and the next instruction before each dispatch.
+#define TRACE_INSTRUCTION()                                                                                            \
+    do {                                                                                                               \
+        if constexpr (Trace) {                                                                                         \
+            SAVE_REGISTERS();                                                                                          \
+            std::print(out, "        ");                                                                               \
+            for (const auto& slot: std::span(stack.data(), top)) {                                                     \
+                std::print(out, "[ ");                                                                                 \
+                printValue(out, slot);                                                                                 \
+                std::print(out, " ]");                                                                                 \
+            }                                                                                                          \
+            std::println(out);                                                                                         \
+            disassembleInstruction(out, *this->chunk, static_cast<int>(ip - chunk->code.data()));                      \
+        }                                                                                                              \
+    } while (false)
+
+// Compiled out unless Profile; otherwise charges the instruction about to dispatch to the profiler.
+#define PROFILE_INSTRUCTION()                                                                                          \
+    do {                                                                                                               \
+        if constexpr (Profile) {                                                                                       \
+            profiler.enter(static_cast<OpCode>(*localIp), static_cast<std::size_t>(localIp - code));                   \
+        }                                                                                                              \
+    } while (false)
+
+// Opcode bodies, without the dispatch. Each base opcode's handler is its body; a superinstruction's handler is the
+// bodies of its parts run back to back, so a fused sequence behaves exactly like the instructions it replaces.
+#define OP_BODY_constant() PUSH(READ_CONSTANT())
+#define OP_BODY_constant_long() PUSH(READ_CONSTANT_LONG())
+#define OP_BODY_nil() PUSH(nilValue())
+#define OP_BODY_op_true() PUSH(boolValue(true))
+#define OP_BODY_op_false() PUSH(boolValue(false))
+#define OP_BODY_equal()                                                                                                \
+    do {                                                                                                               \
+        FLATTEN_ROPES(2);                                                                                              \
+        auto b = POP();                                                                                                \
+        auto a = POP();                                                                                                \
+        PUSH(boolValue(valuesEq(a, b)));                                                                               \
+    } while (false)
+#define OP_BODY_not_equal()                                                                                            \
+    do {                                                                                                               \
+        FLATTEN_ROPES(2);                                                                                              \
+        auto b = POP();                                                                                                \
+        auto a = POP();                                                                                                \
+        PUSH(boolValue(!valuesEq(a, b)));                                                                              \
+    } while (false)
+#define OP_BODY_greater_equal() BINARY_OP(notLess)
+#define OP_BODY_less_equal() BINARY_OP(notGreater)
+#define OP_BODY_greater() BINARY_OP(std::greater<>())
+#define OP_BODY_less() BINARY_OP(std::less<>())
+#define OP_BODY_add()                                                                                                  \
+    do {                                                                                                               \
+        if (isString(PEEK(0)) && isString(PEEK(1))) {                                                                  \
+            QUICKEN(add_str_str);                                                                                      \
+            SAVE_REGISTERS();                                                                                          \
+            concatenate(*this);                                                                                        \
+            LOAD_REGISTERS();                                                                                          \
+        } else if (isNumber(PEEK(0)) && isNumber(PEEK(1))) {                                                           \
+            QUICKEN(add_num_num);                                                                                      \
+            auto b = asNumber(POP());                                                                                  \
+            auto a = asNumber(POP());                                                                                  \
+            PUSH(numberValue(a + b));                                                                                  \
+        } else {                                                                                                       \
+            SAVE_REGISTERS();                                                                                          \
+            formatRuntimeError(*this, "Operands must be two numbers or two strings");                                  \
+            return InterpretResult::runtime_error;                                                                     \
+        }                                                                                                              \
+    } while (false)
+#define OP_BODY_subtract() BINARY_OP(std::minus<>())
+#define OP_BODY_multiply() BINARY_OP(std::multiplies<>())
+#define OP_BODY_divide() BINARY_OP(std::divides<>())
+#define OP_BODY_op_not() (PEEK(0) = boolValue(isFalsey(PEEK(0))))
+#define OP_BODY_negate()                                                                                               \
+    do {                                                                                                               \
+        if (!isNumber(PEEK(0))) {                                                                                      \
+            SAVE_REGISTERS();                                                                                          \
+            formatRuntimeError(*this, "Operand must be a number.");                                                    \
+            return InterpretResult::runtime_error;                                                                     \
+        }                                                                                                              \
+        PEEK(0) = numberValue(-asNumber(PEEK(0)));                                                                     \
+    } while (false)
+// Quickened forms of `add`: one guard instead of add's string-then-number tests. A miss counts against the site,
+// restores `add` and runs it, which may quicken the site again for the new operand types.
+#define OP_BODY_add_num_num()                                                                                          \
+    do {                                                                                                               \
+        if (isNumber(PEEK(0)) && isNumber(PEEK(1))) [[likely]] {                                                       \
+            ++SITE().hits;                                                                                             \
+            auto b = asNumber(POP());                                                                                  \
+            auto a = asNumber(POP());                                                                                  \
+            PUSH(numberValue(a + b));                                                                                  \
+        } else {                                                                                                       \
+            DEQUICKEN();                                                                                               \
+            OP_BODY_add();                                                                                             \
+        }                                                                                                              \
+    } while (false)
+#define OP_BODY_add_str_str()                                                                                          \
+    do {                                                                                                               \
+        if (isString(PEEK(0)) && isString(PEEK(1))) [[likely]] {                                                       \
+            ++SITE().hits;                                                                                             \
+            SAVE_REGISTERS();                                                                                          \
+            concatenate(*this);                                                                                        \
+            LOAD_REGISTERS();                                                                                          \
+        } else {                                                                                                       \
+            DEQUICKEN();                                                                                               \
+            OP_BODY_add();                                                                                             \
+        }                                                                                                              \
+    } while (false)
+#define OP_BODY_ret()                                                                                                  \
+    do {                                                                                                               \
+        FLATTEN_ROPES(1);                                                                                              \
+        printValue(out, POP());                                                                                        \
+        std::println(out);                                                                                             \
+        SAVE_REGISTERS();                                                                                              \
+        return InterpretResult::ok;                                                                                    \
+    } while (false)
 
-        std::println();
-        disassembleInstruction(*this->chunk, static_cast<int>(ip - chunk->code.data()));
+#define BASE_HANDLER(name, operands, ...)                                                                              \
+    CASE(name): {                                                                                                      \
+        [[maybe_unused]] constexpr bool canQuicken = true;                                                             \
+        OP_BODY_##name();                                                                                              \
+        DISPATCH();                                                                                                    \
+    }
+#define FUSED_PART(part) OP_BODY_##part();
+#define FUSED_HANDLER(name, operands, ...)                                                                             \
+    CASE(name): {                                                                                                      \
+        [[maybe_unused]] constexpr bool canQuicken = false;                                                            \
+        FOR_EACH_PART(FUSED_PART, __VA_ARGS__)                                                                         \
+        DISPATCH();                                                                                                    \
+    }
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
 #endif
-        uint8_t instruction = readByte();
+
+template<bool Trace, bool Profile>
+InterpretResult VM::run() {
+    uint8_t* localIp = ip;
+    Value* localTop = top;
+    const Value* constants = chunk->constants.values.data();
+    uint8_t* code = chunk->code.data();
+    QuickenSite* sites = chunk->quickenSites.empty() ? nullptr : chunk->quickenSites.data();
+
+#ifdef COMPUTED_GOTO
+    static void* const dispatchTable[OPCODE_COUNT] = {OPCODE_LIST(OPCODE_LABEL)};
+    DISPATCH();
+#else
+    while (true) {
+        TRACE_INSTRUCTION();
+        PROFILE_INSTRUCTION();
+        uint8_t instruction = READ_BYTE();
         switch (static_cast<OpCode>(instruction)) {
-            case OpCode::constant: {
-                Value constant = readConstant();
-                push(constant);
-                break;
-            }
-            case OpCode::nil:
-                push(nilValue());
-                break;
-            case OpCode::op_true:
-                push(boolValue(true));
-                break;
-            case OpCode::op_false:
-                push(boolValue(false));
-                break;
-            case OpCode::equal: {
-                auto b = pop();
-                auto a = pop();
-                push(boolValue(valuesEq(a, b)));
-                break;
-            }
-            case OpCode::greater:
-                binaryOp(std::greater<>());
-                break;
-            case OpCode::less:
-                binaryOp(std::less<>());
-                break;
-            case OpCode::add: {
-                if (isObjString(peek(0)) && isObjString(peek(1))) {
-                    concatenate();
-                } else if (isNumber(peek(0)) && isNumber(peek(1))) {
-                    auto b = asNumber(pop());
-                    auto a = asNumber(pop());
-                    push(numberValue(a + b));
-                } else {
-                    formatRuntimeError("Operands must be two numbers or two strings");
-                    return InterpretResult::runtime_error;
-                }
-                break;
-            }
-            case OpCode::subtract:
-                binaryOp(std::minus<>());
-                break;
-            case OpCode::multiply:
-                binaryOp(std::multiplies<>());
-                break;
-            case OpCode::divide:
-                binaryOp(std::divides<>());
-                break;
-            case OpCode::op_not:
-                push(boolValue(isFalsey(pop())));
-                break;
-            case OpCode::negate: {
-                if (!isNumber(peek(0))) {
-                    formatRuntimeError("Operand must be a number.");
-                    return InterpretResult::runtime_error;
-                }
-                double value = asNumber(pop());
-                push(numberValue(-value));
-                break;
-            }
-            case OpCode::ret:
-                printValue(pop());
-                std::println();
-                return InterpretResult::ok;
+#endif
+            BASE_OPCODE_LIST(BASE_HANDLER)
+            SUPERINSTRUCTION_LIST(FUSED_HANDLER)
+            QUICKENED_OPCODE_LIST(BASE_HANDLER)
+#ifndef COMPUTED_GOTO
             default:
+                SAVE_REGISTERS();
                 return InterpretResult::compile_error;
         }
     }
+#endif
 }
 
-InterpretResult interpret(std::string_view source) {
-    Chunk chunk{};
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+#undef CASE
+#undef DISPATCH
+#undef TRACE_INSTRUCTION
+#undef PROFILE_INSTRUCTION
+#undef OPCODE_LABEL
+#undef READ_BYTE
+#undef READ_CONSTANT
+#undef READ_CONSTANT_LONG
+#undef PUSH
+#undef POP
+#undef PEEK
+#undef SAVE_REGISTERS
+#undef LOAD_REGISTERS
+#undef SITE
+#undef QUICKEN
+#undef DEQUICKEN
+#undef FLATTEN_ROPES
+#undef BINARY_OP
+#undef OP_BODY_constant
+#undef OP_BODY_constant_long
+#undef OP_BODY_nil
+#undef OP_BODY_op_true
+#undef OP_BODY_op_false
+#undef OP_BODY_equal
+#undef OP_BODY_not_equal
+#undef OP_BODY_greater_equal
+#undef OP_BODY_less_equal
+#undef OP_BODY_greater
+#undef OP_BODY_less
+#undef OP_BODY_add
+#undef OP_BODY_add_num_num
+#undef OP_BODY_add_str_str
+#undef OP_BODY_subtract
+#undef OP_BODY_multiply
+#undef OP_BODY_divide
+#undef OP_BODY_op_not
+#undef OP_BODY_negate
+#undef OP_BODY_ret
+#undef BASE_HANDLER
+#undef FUSED_PART
+#undef FUSED_HANDLER
 
-    if (!compile(source, &chunk)) {
-        return InterpretResult::compile_error;
+void VM::freeVM() {
+    strings.freeTable();
+    grayStack.clear();
+    grayStack.shrink_to_fit();
+    objects = nullptr;
+    sweepObjects = nullptr;
+    gcPhase = GcPhase::idle;
+    arena.freeAll();
+}
+
+InterpretResult VM::interpret(Chunk& script) {
+    chunk = &script;
+    ip = script.code.data();
+    InterpretResult res{};
+    if (profile) {
+        profiler.beginRun(script);
+        res = trace ? run<true, true>() : run<false, true>();
+        profiler.endRun(script);
+    } else {
+        res = trace ? run<true, false>() : run<false, false>();
     }
+    chunk = nullptr;
 
-    vm.chunk = &chunk;
-    vm.ip = vm.chunk->code.data();
-    InterpretResult res = vm.run();
+    if (quickenStats) {
+        printQuickenSites(err, script);
+    }
 
     return res;
 }
@@ -1,8 +1,14 @@
 #pragma once
 
 #include <array>
-#include <string_view>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
 #include "chunk.hpp"
+#include "gc.hpp"
+#include "memory.hpp"
+#include "profiler.hpp"
+#include "table.hpp"
 #include "value.hpp"
 
 constexpr int STACK_MAX = 256;
@@ -13,15 +19,44 @@ enum class InterpretResult : uint8_t {
     runtime_error,
 };
 
+// One interpreter heap and stack. A VM is only ever touched by one thread at a time; separate VMs share nothing, so
+// strings and other objects must not be passed between them.
 struct VM {
     Chunk* chunk{nullptr};
+    // Chunk being filled by the compiler or the .loxc loader; its constants are GC roots until it is handed to run().
+    Chunk* compilingChunk{nullptr};
     uint8_t* ip{nullptr};
     std::array<Value, STACK_MAX> stack{};
     Value* top{nullptr};
     Obj* objects{nullptr};
+    Arena arena{};
+    Table strings{};
+    std::vector<Obj*> grayStack{};
+    std::size_t nextGC{GC_INITIAL_THRESHOLD};
+    GcMode gcMode{GcMode::full};
+    GcPhase gcPhase{GcPhase::idle};
+    Obj* sweepObjects{nullptr};
+    std::size_t sweepStringsCursor{0};
+    std::size_t sweepStringsCapacity{0};
+    GcStats gcStats{};
+    bool gcStress{false};
+    // Print the stack and each instruction as it executes (--trace).
+    bool trace{false};
+    // Count and time every instruction and source line into `profiler` (--profile).
+    bool profile{false};
+    Profiler profiler{};
+    // Print each chunk's quickened sites and their guard counters after it runs.
+    bool quickenStats{false};
+    // Where `ret` prints its result and where runtime and compile errors go. Redirect both to capture a script's output
+    // separately from other VMs running at the same time.
+    std::FILE* out{stdout};
+    std::FILE* err{stderr};
 
-    constexpr VM() = default;
-    constexpr ~VM() = default;
+    VM() { resetStack(); }
+    // `top` points into `stack`, so a VM cannot be copied or moved.
+    VM(const VM& other) = delete;
+    VM& operator=(const VM& other) = delete;
+    ~VM() { freeVM(); }
 
     [[nodiscard]] constexpr uint8_t readByte() { return *ip++; }
     [[nodiscard]] constexpr Value readConstant() { return chunk->constants.values[readByte()]; }
@@ -29,16 +64,12 @@ struct VM {
     constexpr void push(Value value);
     [[nodiscard]] constexpr Value pop();
 
-    // [[nodiscard]] InterpretResult interpret(Chunk* chunk);
+    // The dispatch loop. Trace and Profile select instantiations with per-instruction tracing and profiling, so the
+    // normal one carries no code for either.
+    template<bool Trace, bool Profile>
     [[nodiscard]] InterpretResult run();
+    // Runs a chunk that was compiled (or loaded from a .loxc file) ahead of time.
+    [[nodiscard]] InterpretResult interpret(Chunk& script);
+    // Releases every object and resets the heap; the VM stays usable.
+    void freeVM();
 };
-
-namespace VmInstance {
-    inline constinit VM vm{};
-} // namespace VmInstance
-
-[[nodiscard]] InterpretResult interpret(std::string_view source);
-
-constexpr void initVM() { VmInstance::vm.resetStack(); }
-
-constexpr void freeVM() {}